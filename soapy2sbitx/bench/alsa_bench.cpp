@@ -0,0 +1,136 @@
+// alsa_bench - capture throughput, RW (snd_pcm_readi) vs mmap access
+//
+// Runs the RX front end (mixer + halfband decimator) on live WM8731 capture
+// for a few seconds per mode and reports thread CPU time per period. In mmap
+// mode the DSP reads the DMA area directly; in RW mode ALSA first copies it
+// into a user buffer. Needs the codec (or any 96 kHz S32_LE stereo device).
+//
+//   ./sbitx_alsa_bench [device] [period] [seconds]
+
+#include "HalfbandDecimator.hpp"
+#include "NCO.hpp"
+
+#include <alsa/asoundlib.h>
+
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+static double threadCpuNs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static snd_pcm_t *openCapture(const char *dev, bool mmap, snd_pcm_uframes_t &period)
+{
+    snd_pcm_t *pcm = nullptr;
+    if (snd_pcm_open(&pcm, dev, SND_PCM_STREAM_CAPTURE, 0) < 0) return nullptr;
+
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(pcm, hw);
+    if (snd_pcm_hw_params_set_access(pcm, hw, mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED
+                                                   : SND_PCM_ACCESS_RW_INTERLEAVED) < 0)
+    {
+        snd_pcm_close(pcm);
+        return nullptr;
+    }
+    snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S32_LE);
+    snd_pcm_hw_params_set_channels(pcm, hw, 2);
+    unsigned int rate = 96000;
+    snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, nullptr);
+    snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, nullptr);
+    snd_pcm_uframes_t buffer = period * 4;
+    snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer);
+    if (snd_pcm_hw_params(pcm, hw) < 0)
+    {
+        snd_pcm_close(pcm);
+        return nullptr;
+    }
+    snd_pcm_prepare(pcm);
+    return pcm;
+}
+
+static void run(const char *dev, bool mmap, snd_pcm_uframes_t period, int seconds)
+{
+    snd_pcm_t *pcm = openCapture(dev, mmap, period);
+    if (!pcm)
+    {
+        std::printf("%-5s not available on %s\n", mmap ? "mmap" : "rw", dev);
+        return;
+    }
+
+    NCO nco;
+    nco.setFrequency(24000.0, 96000.0);
+    HalfbandDecimator hb;
+    std::vector<int32_t> frames(period * 2);
+    std::vector<std::complex<float>> out(period / 2 + 1);
+
+    if (mmap) snd_pcm_start(pcm);
+
+    const size_t want = (size_t)seconds * 96000;
+    size_t got = 0, periods = 0, xruns = 0;
+    const double t0 = threadCpuNs();
+    while (got < want)
+    {
+        if (mmap)
+        {
+            snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+            if (avail < 0 || (snd_pcm_uframes_t)avail < period)
+            {
+                const int rc = avail < 0 ? (int)avail : snd_pcm_wait(pcm, 1000);
+                if (rc < 0)
+                {
+                    xruns++;
+                    snd_pcm_recover(pcm, rc, 1);
+                    snd_pcm_start(pcm);
+                }
+                continue;
+            }
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset, n = period;
+            if (snd_pcm_mmap_begin(pcm, &areas, &offset, &n) < 0) continue;
+            const size_t stride = areas[0].step / 32;
+            const int32_t *p = reinterpret_cast<const int32_t *>(
+                static_cast<const uint8_t *>(areas[0].addr) + areas[0].first / 8) + offset * stride;
+            hb.mixDecimate(p, stride, n, nco, out.data());
+            snd_pcm_mmap_commit(pcm, offset, n);
+            got += n;
+        }
+        else
+        {
+            const snd_pcm_sframes_t rd = snd_pcm_readi(pcm, frames.data(), period);
+            if (rd < 0)
+            {
+                xruns++;
+                snd_pcm_recover(pcm, (int)rd, 1);
+                continue;
+            }
+            hb.mixDecimate(frames.data(), 2, (size_t)rd, nco, out.data());
+            got += (size_t)rd;
+        }
+        periods++;
+    }
+    const double cpu = threadCpuNs() - t0;
+    snd_pcm_close(pcm);
+
+    std::printf("%-5s %8zu %12.0f %10.2f %6zu\n", mmap ? "mmap" : "rw", periods,
+                cpu / (double)periods, cpu / (double)got, xruns);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dev = argc > 1 ? argv[1] : "hw:0,0";
+    const snd_pcm_uframes_t period = argc > 2 ? (snd_pcm_uframes_t)std::atol(argv[2]) : 1000;
+    const int seconds = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    std::printf("%s, period %lu, %d s per mode (thread CPU time)\n", dev, (unsigned long)period, seconds);
+    std::printf("%-5s %8s %12s %10s %6s\n", "mode", "periods", "ns/period", "ns/frame", "xruns");
+    run(dev, false, period, seconds);
+    run(dev, true, period, seconds);
+    return 0;
+}
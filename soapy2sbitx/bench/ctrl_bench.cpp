@@ -0,0 +1,288 @@
+// ctrl_bench - sbitx_ctrl command throughput and latency
+//
+// Talks to a running sbitx_ctrl and reports commands/s with p50/p99
+// round-trip latency for three client patterns:
+//   connect  - new TCP connection per command (what the driver used to do)
+//   persist  - N concurrent persistent connections, one command in flight each
+//   pipeline - one connection, a burst of commands per write
+// Only "f" (read frequency) is sent, so the radio is never retuned.
+//
+// With host "unix:<path>" the AF_UNIX socket is used, each test runs with
+// both the text and the binary framing, and the shared-memory state read
+// is timed as well.
+//
+//   ./sbitx_ctrl_bench [host] [port] [seconds] [clients]
+//   ./sbitx_ctrl_bench unix:/run/sbitx.sock - [seconds] [clients]
+
+#include "sbitx_ctrl.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const char *g_host = "127.0.0.1";
+static const char *g_port = "9999";
+static const char *g_unix = nullptr; // AF_UNIX path
+static bool g_binary = false;        // sbitx_ctrl.h frames instead of text
+
+static int openConn()
+{
+    if (g_unix)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, g_unix, sizeof(addr.sun_path) - 1);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(g_host, g_port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next)
+    {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// Read until `n` replies (lines, or frames in binary mode) have arrived.
+static bool readLines(int fd, int n)
+{
+    char buf[4096];
+    size_t bytes = 0;
+    while (n > 0)
+    {
+        const ssize_t r = read(fd, buf, sizeof(buf));
+        if (r <= 0) return false;
+        if (g_binary)
+        {
+            bytes += (size_t)r;
+            n -= (int)(bytes / sizeof(sbitx_frame));
+            bytes %= sizeof(sbitx_frame);
+            continue;
+        }
+        for (ssize_t i = 0; i < r; i++)
+            if (buf[i] == '\n') n--;
+    }
+    return true;
+}
+
+// One "read frequency" request in the current framing.
+static std::string query()
+{
+    if (!g_binary) return "f\n";
+    sbitx_frame f{};
+    f.magic = SBITX_FRAME_MAGIC;
+    f.op = SBITX_OP_GET_FREQ;
+    return std::string(reinterpret_cast<const char *>(&f), sizeof(f));
+}
+
+static bool sendStr(int fd, const std::string &s)
+{
+    return write(fd, s.data(), s.size()) == (ssize_t)s.size();
+}
+
+struct Result
+{
+    std::vector<double> latUs; // per command
+    size_t cmds = 0;
+    double seconds = 0;
+};
+
+static void report(const char *name, Result &r)
+{
+    if (r.latUs.empty())
+    {
+        std::printf("%-16s failed (is sbitx_ctrl running on %s:%s?)\n", name, g_host, g_port);
+        return;
+    }
+    std::sort(r.latUs.begin(), r.latUs.end());
+    const double p50 = r.latUs[r.latUs.size() / 2];
+    const double p99 = r.latUs[std::min(r.latUs.size() - 1, r.latUs.size() * 99 / 100)];
+    std::printf("%-16s %10.0f cmd/s   p50 %8.1f us   p99 %8.1f us\n",
+                name, (double)r.cmds / r.seconds, p50, p99);
+}
+
+static double usSince(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+static Result runConnect(double seconds)
+{
+    Result r;
+    const auto start = Clock::now();
+    while (usSince(start) < seconds * 1e6)
+    {
+        const auto t0 = Clock::now();
+        const int fd = openConn();
+        if (fd < 0) break;
+        const bool ok = sendStr(fd, query()) && readLines(fd, 1);
+        close(fd);
+        if (!ok) break;
+        r.latUs.push_back(usSince(t0));
+        r.cmds++;
+    }
+    r.seconds = usSince(start) / 1e6;
+    return r;
+}
+
+static Result runPersist(double seconds, int clients)
+{
+    Result r;
+    std::mutex m;
+    std::vector<std::thread> th;
+    const auto start = Clock::now();
+    for (int c = 0; c < clients; c++)
+    {
+        th.emplace_back([&] {
+            std::vector<double> lat;
+            const int fd = openConn();
+            if (fd < 0) return;
+            while (usSince(start) < seconds * 1e6)
+            {
+                const auto t0 = Clock::now();
+                if (!sendStr(fd, query()) || !readLines(fd, 1)) break;
+                lat.push_back(usSince(t0));
+            }
+            close(fd);
+            std::lock_guard<std::mutex> g(m);
+            r.latUs.insert(r.latUs.end(), lat.begin(), lat.end());
+            r.cmds += lat.size();
+        });
+    }
+    for (auto &t : th) t.join();
+    r.seconds = usSince(start) / 1e6;
+    return r;
+}
+
+// Latency here is per burst divided by depth: the cost one command adds.
+static Result runPipeline(double seconds, int depth)
+{
+    Result r;
+    const int fd = openConn();
+    if (fd < 0) return r;
+
+    std::string burst;
+    for (int i = 0; i < depth; i++) burst += query();
+
+    const auto start = Clock::now();
+    while (usSince(start) < seconds * 1e6)
+    {
+        const auto t0 = Clock::now();
+        if (!sendStr(fd, burst) || !readLines(fd, depth)) break;
+        r.latUs.push_back(usSince(t0) / depth);
+        r.cmds += (size_t)depth;
+    }
+    close(fd);
+    r.seconds = usSince(start) / 1e6;
+    return r;
+}
+
+static void runAll(double seconds, int clients, const char *tag)
+{
+    char name[32];
+    Result r = runConnect(seconds);
+    std::snprintf(name, sizeof(name), "connect%s", tag);
+    report(name, r);
+
+    r = runPersist(seconds, 1);
+    std::snprintf(name, sizeof(name), "persist x1%s", tag);
+    report(name, r);
+
+    r = runPersist(seconds, clients);
+    std::snprintf(name, sizeof(name), "persist x%d%s", clients, tag);
+    report(name, r);
+
+    r = runPipeline(seconds, 16);
+    std::snprintf(name, sizeof(name), "pipeline x16%s", tag);
+    report(name, r);
+}
+
+// The driver's getFrequency path with ctrl=unix: a seqlock read.
+static void runShm()
+{
+    const int fd = shm_open(SBITX_SHM_NAME, O_RDONLY, 0);
+    void *p = fd >= 0 ? mmap(nullptr, sizeof(sbitx_shm), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0) close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::printf("%-16s failed (no %s)\n", "shm read", SBITX_SHM_NAME);
+        return;
+    }
+
+    const auto *shm = static_cast<const sbitx_shm *>(p);
+    const int n = 10000000;
+    uint32_t hz = 0, ptt = 0, sum = 0;
+    uint64_t beat = 0;
+    const auto t0 = Clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        sbitx_shm_read(shm, &hz, &ptt, &beat);
+        sum += hz;
+    }
+    const double ns = usSince(t0) * 1e3 / n;
+    std::printf("%-16s %10.1f ns/read   (%u Hz%s)\n", "shm read", ns, hz, sum ? "" : ", never written");
+    munmap(p, sizeof(sbitx_shm));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) g_host = argv[1];
+    if (argc > 2) g_port = argv[2];
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+    const int clients = argc > 4 ? std::max(1, std::atoi(argv[4])) : 8;
+
+    if (std::strncmp(g_host, "unix:", 5) == 0)
+    {
+        g_unix = g_host + 5;
+        std::printf("sbitx_ctrl at %s, %.1f s per test\n", g_unix, seconds);
+        runAll(seconds, clients, "");
+        g_binary = true;
+        runAll(seconds, clients, " bin");
+        runShm();
+        return 0;
+    }
+
+    std::printf("sbitx_ctrl at %s:%s, %.1f s per test\n", g_host, g_port, seconds);
+    runAll(seconds, clients, "");
+    return 0;
+}
@@ -0,0 +1,186 @@
+// dsp_bench - RX and TX signal path throughput, no radio needed
+//
+// Drives the same RxChain / TxChain the driver's threads use (DspChain.hpp)
+// with synthetic 96 kHz S32_LE stereo periods (IF tone plus noise on the
+// left channel) and reports, per period size:
+//   MS/s      capture (RX) or playback (TX) frames processed per second
+//   ns/smp    wall time per frame
+//   cyc/smp   CPU cycles per frame (perf_event_open; "-" where unavailable)
+//   allocs    heap allocations per period inside the timed loop (want 0)
+//
+//   ./sbitx_dsp_bench [period ...]
+
+#include "DspChain.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const unsigned kCapFs = 96000;
+static const unsigned kFs = 48000;
+static const double kIf = 24000.0;
+
+// Every heap allocation in the process goes through here.
+static size_t g_allocs = 0;
+
+void *operator new(size_t n)
+{
+    g_allocs++;
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// User-space cycle counter for this thread; -1 fd when perf is unavailable.
+class Cycles
+{
+public:
+    Cycles()
+    {
+#ifdef __linux__
+        perf_event_attr a;
+        std::memset(&a, 0, sizeof(a));
+        a.type = PERF_TYPE_HARDWARE;
+        a.size = sizeof(a);
+        a.config = PERF_COUNT_HW_CPU_CYCLES;
+        a.disabled = 1;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        fd_ = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+#endif
+    }
+    ~Cycles()
+    {
+#ifdef __linux__
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool ok() const { return fd_ >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    unsigned long long stop()
+    {
+        unsigned long long v = 0;
+#ifdef __linux__
+        if (fd_ < 0) return 0;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &v, sizeof(v)) != (ssize_t)sizeof(v)) v = 0;
+#endif
+        return v;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+static std::vector<int32_t> capture(size_t frames)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 1e-3);
+    std::vector<int32_t> v(frames * 2, 0);
+    for (size_t n = 0; n < frames; n++)
+    {
+        const double x = 0.5 * std::cos(2.0 * M_PI * (kIf + 1234.0) * (double)n / kCapFs) + noise(rng);
+        v[n * 2] = (int32_t)std::lrint(x * 2147483647.0);
+    }
+    return v;
+}
+
+static void report(const char *name, size_t period, size_t frames, double ns,
+                   unsigned long long cycles, bool haveCycles, size_t allocs, size_t periods)
+{
+    char cyc[32] = "-";
+    if (haveCycles) std::snprintf(cyc, sizeof(cyc), "%.2f", (double)cycles / (double)frames);
+    std::printf("%-14s %7zu %9.1f %8.2f %8s %8.2f\n", name, period,
+                (double)frames / ns * 1e3, ns / (double)frames, cyc,
+                (double)allocs / (double)periods);
+}
+
+// Runs `body` once per period for about half a second.
+template <typename F>
+static void timeIt(const char *name, size_t period, size_t framesPerCall, F &&body)
+{
+    for (int i = 0; i < 50; i++) body(); // warm-up: caches, lazy scratch
+
+    Cycles cycles;
+    const size_t iters = std::max<size_t>(200, 48000000 / period);
+    const size_t allocs0 = g_allocs;
+    cycles.start();
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; i++) body();
+    const auto t1 = std::chrono::steady_clock::now();
+    const unsigned long long cyc = cycles.stop();
+    const size_t allocs = g_allocs - allocs0;
+
+    report(name, period, framesPerCall * iters,
+           std::chrono::duration<double, std::nano>(t1 - t0).count(), cyc, cycles.ok(), allocs, iters);
+}
+
+static void benchRx(const char *name, RxFormat fmt, unsigned outFs, size_t period)
+{
+    const std::vector<int32_t> in = capture(period);
+    RxChain rx(kCapFs, kFs, kIf, HalfbandDecimator::kDefaultTaps);
+    rx.configure(fmt, outFs, period);
+
+    volatile size_t sink = 0;
+    timeIt(name, period, period, [&] {
+        const void *out = nullptr;
+        sink = sink + rx.process(in.data(), 2, period, out);
+    });
+}
+
+static void benchTx(size_t period)
+{
+    std::vector<std::complex<float>> iq(period / 2);
+    for (size_t n = 0; n < iq.size(); n++)
+        iq[n] = std::polar(0.5f, (float)(2.0 * M_PI * 1500.0 * (double)n / kFs));
+    std::vector<int32_t> frames(period * 2);
+    TxChain tx(kCapFs, kIf);
+
+    timeIt("tx upconvert", period, period, [&] {
+        tx.upconvert(iq.data(), 0, period, frames.data(), 2, 1.0f, false);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> periods;
+    for (int i = 1; i < argc; i++) periods.push_back((size_t)std::atol(argv[i]));
+    if (periods.empty()) periods = {256, 500, 1000, 2048, 4096};
+
+    std::printf("96 kHz S32 stereo in, IF %.0f Hz, %u-tap halfband\n", kIf, HalfbandDecimator::kDefaultTaps);
+    std::printf("%-14s %7s %9s %8s %8s %8s\n", "chain", "period", "MS/s", "ns/smp", "cyc/smp", "allocs");
+
+    for (size_t p : periods)
+    {
+        benchRx("rx cf32 48k", RX_CF32, 48000, p);
+        benchRx("rx cs16 48k", RX_CS16, 48000, p);
+        benchRx("rx cf32 12k", RX_CF32, 12000, p);
+        benchRx("rx cs16 50k", RX_CS16, 50000, p);
+        benchTx(p);
+    }
+    return 0;
+}
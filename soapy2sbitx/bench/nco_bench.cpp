@@ -0,0 +1,137 @@
+// nco_bench - compare the NCO against per-sample double trig
+//
+// Reports ns/sample for generating the RX mixer's LO and the worst spur
+// (relative to the carrier) in an FFT of the generated tone.
+//
+//   ./sbitx_nco_bench [freq_hz] [fs_hz]
+
+#include "NCO.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using cf = std::complex<float>;
+using cd = std::complex<double>;
+
+static void fft(std::vector<cd> &a)
+{
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const cd wl = std::polar(1.0, -2.0 * M_PI / (double)len);
+        for (size_t i = 0; i < n; i += len)
+        {
+            cd w(1.0, 0.0);
+            for (size_t k = 0; k < len / 2; k++)
+            {
+                const cd u = a[i + k];
+                const cd v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= wl;
+            }
+        }
+    }
+}
+
+// Largest bin outside +-guard bins of the carrier, in dBc. The tone is
+// placed exactly on a bin (see main), so no window is needed and the
+// floor is set by the oscillator, not by leakage.
+static double worstSpurDbc(const std::vector<cf> &x)
+{
+    const size_t n = x.size();
+    std::vector<cd> a(n);
+    for (size_t i = 0; i < n; i++) a[i] = cd(x[i].real(), x[i].imag());
+    fft(a);
+
+    size_t peak = 0;
+    for (size_t i = 1; i < n; i++)
+        if (std::norm(a[i]) > std::norm(a[peak])) peak = i;
+
+    const size_t guard = 2;
+    double spur = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const size_t d = std::min((i + n - peak) % n, (peak + n - i) % n);
+        if (d > guard) spur = std::max(spur, std::norm(a[i]));
+    }
+    return 10.0 * std::log10(std::max(spur, 1e-300) / std::norm(a[peak]));
+}
+
+// The mixer LO exactly as rxThreadMain used to compute it.
+static void trigLo(cf *out, size_t n, double w, double &ph)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = cf((float)std::cos(ph), (float)std::sin(ph));
+        ph += w;
+        if (ph > M_PI) ph -= 2.0 * M_PI;
+    }
+}
+
+static void ncoLo(cf *out, size_t n, NCO &nco)
+{
+    for (size_t i = 0; i < n; i++) out[i] = nco.next();
+}
+
+template <typename F>
+static double nsPerSample(F &&gen, std::vector<cf> &buf, size_t total)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < total; done += buf.size()) gen(buf.data(), buf.size());
+    const auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)total;
+}
+
+int main(int argc, char **argv)
+{
+    const double f = argc > 1 ? std::atof(argv[1]) : 24000.0 + 1234.567;
+    const double fs = argc > 2 ? std::atof(argv[2]) : 96000.0;
+    const size_t total = 96000 * 20; // 20 s of capture
+    const size_t nfft = 1 << 16;
+
+    std::vector<cf> buf(1000);
+    double sink = 0.0;
+
+    double ph = 0.0;
+    const double w = 2.0 * M_PI * f / fs;
+    const double nsTrig = nsPerSample([&](cf *o, size_t n) { trigLo(o, n, w, ph); sink += o[0].real(); }, buf, total);
+
+    NCO nco;
+    nco.setFrequency(f, fs);
+    const double nsNco = nsPerSample([&](cf *o, size_t n) { ncoLo(o, n, nco); sink += o[0].real(); }, buf, total);
+
+    // Snap to an FFT bin; with nfft = 2^16 the NCO tuning word for a bin
+    // centre is exact (k * 2^16), so both generators hit the bin precisely.
+    const double fb = std::round(f * (double)nfft / fs) * fs / (double)nfft;
+    const double wb = 2.0 * M_PI * fb / fs;
+
+    std::vector<cf> tone(nfft);
+    ph = 0.0;
+    trigLo(tone.data(), nfft, wb, ph);
+    const double spurTrig = worstSpurDbc(tone);
+
+    NCO nco2;
+    nco2.setFrequency(fb, fs);
+    ncoLo(tone.data(), nfft, nco2);
+    const double spurNco = worstSpurDbc(tone);
+
+    std::printf("tone %.3f Hz @ %.0f Hz, %zu samples; spur FFT %zu at %.3f Hz\n", f, fs, total, nfft, fb);
+    std::printf("%-12s %10s %14s\n", "lo", "ns/sample", "worst spur dBc");
+    std::printf("%-12s %10.2f %14.1f\n", "double trig", nsTrig, spurTrig);
+    std::printf("%-12s %10.2f %14.1f\n", "nco", nsNco, spurNco);
+    std::printf("speedup %.1fx\n", nsTrig / nsNco);
+    return sink == 12345.0; // keep the loops alive
+}
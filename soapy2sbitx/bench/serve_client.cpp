@@ -0,0 +1,228 @@
+// serve_client - loopback check of the driver's serve= IQ server
+//
+// Connects to a running server (any program with the SBITX device open and
+// serve= set, e.g. SoapySDRUtil --args="driver=sbitx,serve=127.0.0.1:1234"
+// --rate=48000), checks the 12-byte header and decodes the samples that
+// follow in whichever serve_fmt the header announces, reporting the
+// sample rate it measures against the one the header claims, RMS and peak
+// level, and any value a format should never carry. Nothing is sent, so
+// the radio is never retuned.
+//
+// Exits non-zero on a bad header, a format other than the expected one,
+// a malformed cs8 block or a short read.
+//
+//   ./sbitx_serve_client [host] [port] [cu8|cs8|cs16|cf32|any] [blocks]
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Samples per decoded block for the unframed formats
+static const size_t kBlock = 4096;
+
+// A cs8 block longer than this is not one the server would send
+static const uint32_t kMaxCs8Block = 1u << 20;
+
+static const char *kFormats[] = {"cu8", "cs8", "cs16", "cf32"};
+
+static uint32_t getBe32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int openConn(const char *host, const char *port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next)
+    {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool readAll(int fd, void *dst, size_t n)
+{
+    uint8_t *p = static_cast<uint8_t *>(dst);
+    while (n)
+    {
+        const ssize_t r = recv(fd, p, n, 0);
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+struct Level
+{
+    double sumSq = 0.0;
+    double peak = 0.0;
+    size_t n = 0;
+
+    void add(float i, float q)
+    {
+        const double m = (double)i * i + (double)q * q;
+        sumSq += m;
+        peak = std::max(peak, m);
+        n++;
+    }
+    double rmsDb() const { return n ? 10.0 * std::log10(sumSq / n + 1e-30) : -300.0; }
+    double peakDb() const { return 10.0 * std::log10(peak + 1e-30); }
+};
+
+int main(int argc, char **argv)
+{
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    const char *port = argc > 2 ? argv[2] : "1234";
+    const std::string want = argc > 3 ? argv[3] : "any";
+    const int blocks = argc > 4 ? std::atoi(argv[4]) : 50;
+
+    const int fd = openConn(host, port);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "cannot connect to %s:%s\n", host, port);
+        return 1;
+    }
+
+    uint8_t hdr[12];
+    if (!readAll(fd, hdr, sizeof(hdr)))
+    {
+        std::fprintf(stderr, "no header\n");
+        return 1;
+    }
+
+    // "RTL0": cu8 with rtl_tcp's tuner type and gain count. "SBX0": the
+    // format (1 cs8, 2 cs16, 3 cf32) and the rate.
+    int fmt = -1;
+    uint32_t rate = 0;
+    if (std::memcmp(hdr, "RTL0", 4) == 0)
+    {
+        fmt = 0;
+        std::printf("header RTL0: tuner %u, %u gains\n", getBe32(hdr + 4), getBe32(hdr + 8));
+    }
+    else if (std::memcmp(hdr, "SBX0", 4) == 0 && getBe32(hdr + 4) >= 1 && getBe32(hdr + 4) <= 3)
+    {
+        fmt = (int)getBe32(hdr + 4);
+        rate = getBe32(hdr + 8);
+        std::printf("header SBX0: %s at %u sps\n", kFormats[fmt], rate);
+    }
+    else
+    {
+        std::fprintf(stderr, "bad header %02x %02x %02x %02x\n", hdr[0], hdr[1], hdr[2], hdr[3]);
+        return 1;
+    }
+    if (want != "any" && want != kFormats[fmt])
+    {
+        std::fprintf(stderr, "server sends %s, expected %s\n", kFormats[fmt], want.c_str());
+        return 1;
+    }
+
+    Level level;
+    size_t bad = 0;
+    size_t samples = 0;
+    std::vector<uint8_t> buf;
+    Clock::time_point t0;
+    int done = 0;
+
+    for (int b = 0; b < blocks; b++, done++)
+    {
+        size_t n = kBlock;
+        if (fmt == 1)
+        {
+            // [u32 LE samples][f32 LE scale][samples x (i8 I, i8 Q)]
+            uint8_t head[8];
+            uint32_t count = 0;
+            float scale = 0.0f;
+            if (!readAll(fd, head, sizeof(head))) break;
+            std::memcpy(&count, head, 4);
+            std::memcpy(&scale, head + 4, 4);
+            if (count == 0 || count > kMaxCs8Block || !(scale > 0.0f) || !std::isfinite(scale))
+            {
+                std::fprintf(stderr, "block %d: bad cs8 frame (%u samples, scale %g)\n", b, count, scale);
+                return 1;
+            }
+            n = count;
+            buf.resize(2 * n);
+            if (!readAll(fd, buf.data(), buf.size())) break;
+            const int8_t *p = reinterpret_cast<const int8_t *>(buf.data());
+            for (size_t i = 0; i < n; i++)
+            {
+                if (p[2 * i] == -128 || p[2 * i + 1] == -128) bad++; // the server clamps to +-127
+                level.add(p[2 * i] * scale, p[2 * i + 1] * scale);
+            }
+        }
+        else
+        {
+            const size_t bytes = fmt == 0 ? 2 : fmt == 2 ? 4 : 8;
+            buf.resize(n * bytes);
+            if (!readAll(fd, buf.data(), buf.size())) break;
+            for (size_t i = 0; i < n; i++)
+            {
+                float I, Q;
+                if (fmt == 0)
+                {
+                    I = (buf[2 * i] - 127.5f) / 127.5f;
+                    Q = (buf[2 * i + 1] - 127.5f) / 127.5f;
+                }
+                else if (fmt == 2)
+                {
+                    int16_t v[2];
+                    std::memcpy(v, &buf[4 * i], sizeof(v));
+                    if (v[0] == -32768 || v[1] == -32768) bad++; // the server clamps to +-32767
+                    I = v[0] / 32767.0f;
+                    Q = v[1] / 32767.0f;
+                }
+                else
+                {
+                    std::memcpy(&I, &buf[8 * i], 4);
+                    std::memcpy(&Q, &buf[8 * i + 4], 4);
+                    if (!std::isfinite(I) || !std::isfinite(Q)) bad++;
+                }
+                level.add(I, Q);
+            }
+        }
+
+        // Time from the end of the first block, past whatever was queued
+        // before we started reading.
+        if (b == 0) t0 = Clock::now();
+        else samples += n;
+    }
+    close(fd);
+
+    const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    if (done < blocks || samples == 0)
+    {
+        std::fprintf(stderr, "connection closed after %d of %d blocks\n", done, blocks);
+        return 1;
+    }
+
+    std::printf("%zu samples: %.0f sps measured", level.n, secs > 0.0 ? samples / secs : 0.0);
+    if (rate) std::printf(" (header %u)", rate);
+    std::printf(", rms %.1f dBFS, peak %.1f dBFS, %zu out-of-format values\n",
+                level.rmsDb(), level.peakDb(), bad);
+    return bad ? 1 : 0;
+}
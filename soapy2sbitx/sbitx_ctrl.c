@@ -1,12 +1,26 @@
 /* sbitx_ctrl.c - simple TCP control for sBitx core (freq + PTT)
  *
- * Listens on 127.0.0.1:9999
+ * Listens on 127.0.0.1:9999 and on the AF_UNIX socket /run/sbitx.sock (or
+ * the path given as the first argument). Connections may stay open and send
+ * several commands back to back; every command gets exactly one reply, in
+ * order. Besides the text commands below, any connection may send the
+ * fixed-size binary frames described in sbitx_ctrl.h.
+ *
+ * The current state is also published in shared memory (SBITX_SHM_NAME) as
+ * a seqlock-protected block, so local readers need no round trip at all.
  *
  * Commands (one per line):
  *   f              -> print frequency (Hz)
  *   F <hz>         -> set frequency (Hz), reply "OK <hz>"
  *   t              -> print ptt state (0 RX, 1 TX)
  *   T <0|1>         -> set ptt state, reply "OK <0|1>"
+ *   S              -> subscribe: the connection stops taking commands and
+ *                     instead receives "! <hz> <ptt>" immediately, on every
+ *                     change, and at least once a second as a heartbeat
+ *
+ * Single-threaded: one epoll loop owns the listening sockets and every
+ * connection, each with its own input line buffer and output buffer.
+ * Nothing blocks except the radio calls, which are serialised anyway.
  */
 
 #define _GNU_SOURCE
@@ -14,7 +28,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <netinet/in.h>
-#include <pthread.h>
+#include <netinet/tcp.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -22,142 +36,324 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "sbitx_core.h"
+#include "sbitx_ctrl.h"
 
 static volatile int g_shutdown = 0;
 
 static radio g_radio;
-static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Keep our own "current frequency" so we can answer quickly and consistently.
 static uint32_t g_freq_hz = 7100000; // default
 static int g_ptt_tx = 0;            // 0=RX, 1=TX
 
+#define SUB_HEARTBEAT_MS 1000
+#define MAX_EVENTS 64
+#define IN_BUF 512   // longest accepted command line
+#define OUT_BUF 8192 // a client this far behind on replies is dropped
+
+struct conn {
+  int fd;
+  bool subscribed;
+  bool want_out; // EPOLLOUT armed
+  bool dead;     // closed at the end of the loop iteration
+  size_t in_len;
+  size_t out_len;
+  char in[IN_BUF];
+  char out[OUT_BUF];
+  struct conn *next;
+};
+
+static int g_epfd = -1;
+static struct conn *g_conns = NULL;
+
+// Listening sockets; epoll carries a pointer to one of these for them.
+static int g_tcp_fd = -1;
+static int g_unix_fd = -1;
+
+static struct sbitx_shm *g_shm = NULL;
+
 static void on_sigint(int sig) {
   (void)sig;
   g_shutdown = 1;
 }
 
-static void replyf(FILE *fp, const char *fmt, ...) {
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// Close every connection marked dead. Only called between batches of
+// epoll events, so no pending event can point at a freed conn.
+static void reap_conns(bool all) {
+  struct conn **pp = &g_conns;
+  while (*pp) {
+    struct conn *c = *pp;
+    if (!c->dead && !all) {
+      pp = &c->next;
+      continue;
+    }
+    *pp = c->next;
+    epoll_ctl(g_epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c);
+  }
+}
+
+// Queue a reply; false if the client has stopped reading.
+static bool replyf(struct conn *c, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static bool replyf(struct conn *c, const char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
-  vfprintf(fp, fmt, ap);
+  int n = vsnprintf(c->out + c->out_len, OUT_BUF - c->out_len, fmt, ap);
   va_end(ap);
-  fflush(fp);
+  if (n < 0 || (size_t)n >= OUT_BUF - c->out_len)
+    return false;
+  c->out_len += (size_t)n;
+  return true;
+}
+
+// Write as much of the output buffer as the socket takes now; arm
+// EPOLLOUT for the rest. False on a dead connection.
+static bool conn_flush(struct conn *c) {
+  size_t off = 0;
+  while (off < c->out_len) {
+    ssize_t w = send(c->fd, c->out + off, c->out_len - off, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (w <= 0)
+      return false;
+    off += (size_t)w;
+  }
+  memmove(c->out, c->out + off, c->out_len - off);
+  c->out_len -= off;
+
+  bool want = c->out_len > 0;
+  if (want != c->want_out) {
+    struct epoll_event ev = {.events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = c};
+    epoll_ctl(g_epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_out = want;
+  }
+  return true;
+}
+
+static bool reply_frame(struct conn *c, uint8_t op, uint8_t status, uint32_t value) {
+  struct sbitx_frame f = {SBITX_FRAME_MAGIC, op, status, 0, value};
+  if (sizeof(f) > OUT_BUF - c->out_len)
+    return false;
+  memcpy(c->out + c->out_len, &f, sizeof(f));
+  c->out_len += sizeof(f);
+  return true;
+}
+
+// Publish the current state: shared memory first, then every subscriber.
+// Slow subscribers are dropped rather than allowed to hold up the loop.
+static void broadcast_state(void) {
+  if (g_shm)
+    sbitx_shm_write(g_shm, g_freq_hz, (uint32_t)g_ptt_tx, now_ms());
+
+  for (struct conn *c = g_conns; c; c = c->next) {
+    if (c->subscribed && !c->dead &&
+        (!replyf(c, "! %u %d\n", g_freq_hz, g_ptt_tx) || !conn_flush(c)))
+      c->dead = true;
+  }
 }
 
 static void do_set_freq(uint32_t hz) {
-  pthread_mutex_lock(&g_lock);
   g_freq_hz = hz;
   set_frequency(&g_radio, g_freq_hz);
-  pthread_mutex_unlock(&g_lock);
-}
-
-static uint32_t do_get_freq(void) {
-  pthread_mutex_lock(&g_lock);
-  uint32_t hz = g_freq_hz;
-  pthread_mutex_unlock(&g_lock);
-  return hz;
+  broadcast_state();
 }
 
 static void do_set_ptt(int tx) {
-  pthread_mutex_lock(&g_lock);
   g_ptt_tx = tx ? 1 : 0;
   tr_switch(&g_radio, g_ptt_tx ? IN_TX : IN_RX);
-  pthread_mutex_unlock(&g_lock);
+  broadcast_state();
 }
 
-static int do_get_ptt(void) {
-  pthread_mutex_lock(&g_lock);
-  int tx = g_ptt_tx;
-  pthread_mutex_unlock(&g_lock);
-  return tx;
-}
+// One command line; false if the reply could not be queued.
+static bool handle_line(struct conn *c, const char *line) {
+  // Commands:
+  // f
+  // F <hz>
+  // t
+  // T <0|1>
+  // S
+
+  if (line[0] == 'f' && line[1] == 0)
+    return replyf(c, "%u\n", g_freq_hz);
+
+  if (line[0] == 'F') {
+    // allow "F14234000" or "F 14234000"
+    const char *p = line + 1;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == 0)
+      return replyf(c, "ERR missing\n");
+    uint32_t hz = (uint32_t)strtoul(p, NULL, 10);
+    if (hz < 100000 || hz > 600000000)
+      return replyf(c, "ERR range\n");
+    bool ok = replyf(c, "OK %u\n", hz);
+    do_set_freq(hz);
+    return ok;
+  }
 
-static void *client_thread(void *arg) {
-  int fd = (int)(intptr_t)arg;
-  FILE *fp = fdopen(fd, "r+");
-  if (!fp) {
-    close(fd);
-    return NULL;
+  if (line[0] == 't' && line[1] == 0)
+    return replyf(c, "%d\n", g_ptt_tx);
+
+  if (line[0] == 'T') {
+    const char *p = line + 1;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p != '0' && *p != '1')
+      return replyf(c, "ERR arg\n");
+    int tx = (*p == '1') ? 1 : 0;
+    bool ok = replyf(c, "OK %d\n", tx);
+    do_set_ptt(tx);
+    return ok;
   }
 
-  char line[256];
-  while (!g_shutdown && fgets(line, sizeof(line), fp)) {
-    // trim newline
-    size_t n = strlen(line);
-    while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'))
-      line[--n] = 0;
+  if (line[0] == 'S' && line[1] == 0) {
+    c->subscribed = true;
+    return replyf(c, "! %u %d\n", g_freq_hz, g_ptt_tx);
+  }
 
-    // ignore empty
-    if (n == 0)
-      continue;
+  return replyf(c, "ERR unknown\n");
+}
 
-    // Commands:
-    // f
-    // F <hz>
-    // t
-    // T <0|1>
+// One binary frame; false if the reply could not be queued.
+static bool handle_frame(struct conn *c, const struct sbitx_frame *f) {
+  switch (f->op) {
+  case SBITX_OP_GET_FREQ:
+    return reply_frame(c, f->op, SBITX_ST_OK, g_freq_hz);
+  case SBITX_OP_SET_FREQ:
+    if (f->value < 100000 || f->value > 600000000)
+      return reply_frame(c, f->op, SBITX_ST_ERR, g_freq_hz);
+    if (!reply_frame(c, f->op, SBITX_ST_OK, f->value))
+      return false;
+    do_set_freq(f->value);
+    return true;
+  case SBITX_OP_GET_PTT:
+    return reply_frame(c, f->op, SBITX_ST_OK, (uint32_t)g_ptt_tx);
+  case SBITX_OP_SET_PTT:
+    if (f->value > 1)
+      return reply_frame(c, f->op, SBITX_ST_ERR, (uint32_t)g_ptt_tx);
+    if (!reply_frame(c, f->op, SBITX_ST_OK, f->value))
+      return false;
+    do_set_ptt((int)f->value);
+    return true;
+  default:
+    return reply_frame(c, f->op, SBITX_ST_ERR, 0);
+  }
+}
 
-    if (line[0] == 'f' && line[1] == 0) {
-      uint32_t hz = do_get_freq();
-      replyf(fp, "%u\n", hz);
+// Drain the socket and run every complete line or frame. False to close.
+static bool conn_read(struct conn *c) {
+  for (;;) {
+    ssize_t r = recv(c->fd, c->in + c->in_len, IN_BUF - c->in_len, 0);
+    if (r < 0 && errno == EINTR)
       continue;
-    }
-
-    if (line[0] == 'F') {
-      // allow "F14234000" or "F 14234000"
-      const char *p = line + 1;
-      while (*p == ' ' || *p == '\t')
-        p++;
-      if (*p == 0) {
-        replyf(fp, "ERR missing\n");
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (r <= 0)
+      return false;
+    c->in_len += (size_t)r;
+
+    size_t start = 0;
+    while (start < c->in_len) {
+      // subscribers no longer take commands
+      if ((uint8_t)c->in[start] == SBITX_FRAME_MAGIC) {
+        struct sbitx_frame f;
+        if (c->in_len - start < sizeof(f))
+          break;
+        memcpy(&f, c->in + start, sizeof(f));
+        start += sizeof(f);
+        if (!c->subscribed && !handle_frame(c, &f))
+          return false;
         continue;
       }
-      uint32_t hz = (uint32_t)strtoul(p, NULL, 10);
-      if (hz < 100000 || hz > 600000000) {
-        replyf(fp, "ERR range\n");
+
+      char *nl = memchr(c->in + start, '\n', c->in_len - start);
+      if (!nl)
+        break;
+      // trim newline
+      size_t end = (size_t)(nl - c->in);
+      size_t next = end + 1;
+      if (end > start && c->in[end - 1] == '\r')
+        end--;
+      c->in[end] = 0;
+      const char *line = c->in + start;
+      start = next;
+
+      // ignore empty
+      if (line[0] == 0 || c->subscribed)
         continue;
-      }
-      do_set_freq(hz);
-      replyf(fp, "OK %u\n", hz);
-      continue;
+      if (!handle_line(c, line))
+        return false;
     }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
 
-    if (line[0] == 't' && line[1] == 0) {
-      replyf(fp, "%d\n", do_get_ptt());
-      continue;
+    if (c->in_len == IN_BUF) {
+      if (!replyf(c, "ERR long\n"))
+        return false;
+      c->in_len = 0;
     }
+  }
+  return conn_flush(c);
+}
 
-    if (line[0] == 'T') {
-      const char *p = line + 1;
-      while (*p == ' ' || *p == '\t')
-        p++;
-      if (*p != '0' && *p != '1') {
-        replyf(fp, "ERR arg\n");
+static void accept_all(int listen_fd) {
+  for (;;) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR)
         continue;
-      }
-      int tx = (*p == '1') ? 1 : 0;
-      do_set_ptt(tx);
-      replyf(fp, "OK %d\n", tx);
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+      return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails on AF_UNIX, harmless
+
+    struct conn *c = calloc(1, sizeof(*c));
+    if (!c) {
+      close(fd);
       continue;
     }
+    c->fd = fd;
 
-    replyf(fp, "ERR unknown\n");
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      free(c);
+      continue;
+    }
+    c->next = g_conns;
+    g_conns = c;
   }
-
-  fclose(fp); // closes fd
-  return NULL;
 }
 
 int main(int argc, char **argv) {
-  (void)argc;
-  (void)argv;
+  const char *unix_path = argc > 1 ? argv[1] : SBITX_UNIX_PATH;
 
   signal(SIGINT, on_sigint);
+  signal(SIGPIPE, SIG_IGN); // a vanished client is a write error, not a crash
 
   memset(&g_radio, 0, sizeof(g_radio));
   // These must match your working "simple radio" app:
@@ -167,59 +363,142 @@ int main(int argc, char **argv) {
 
   hw_init(&g_radio);
 
-  // Start in RX
-  do_set_ptt(0);
-  // Set initial freq
-  do_set_freq(g_freq_hz);
+  g_epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (g_epfd < 0) {
+    perror("epoll_create1");
+    return 1;
+  }
 
-  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_fd < 0) {
+  g_tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (g_tcp_fd < 0) {
     perror("socket");
     return 1;
   }
 
   int one = 1;
-  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(g_tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
 
   struct sockaddr_in addr;
   memset(&addr, 0, sizeof(addr));
   addr.sin_family = AF_INET;
-  addr.sin_port = htons(9999);
+  addr.sin_port = htons(SBITX_TCP_PORT);
   inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
 
-  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+  if (bind(g_tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
     perror("bind");
-    close(listen_fd);
+    close(g_tcp_fd);
     return 1;
   }
 
-  if (listen(listen_fd, 8) < 0) {
+  if (listen(g_tcp_fd, 64) < 0) {
     perror("listen");
-    close(listen_fd);
+    close(g_tcp_fd);
     return 1;
   }
 
-  printf("sbitx_ctrl listening on 127.0.0.1:9999\n");
+  struct epoll_event lev = {.events = EPOLLIN, .data.ptr = &g_tcp_fd};
+  epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_tcp_fd, &lev);
+
+  // Local socket: optional, TCP keeps working if it cannot be created.
+  struct sockaddr_un uaddr;
+  memset(&uaddr, 0, sizeof(uaddr));
+  uaddr.sun_family = AF_UNIX;
+  if (strlen(unix_path) < sizeof(uaddr.sun_path)) {
+    strcpy(uaddr.sun_path, unix_path);
+    unlink(unix_path);
+    g_unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (g_unix_fd >= 0 &&
+        (bind(g_unix_fd, (struct sockaddr *)&uaddr, sizeof(uaddr)) < 0 ||
+         listen(g_unix_fd, 64) < 0)) {
+      perror(unix_path);
+      close(g_unix_fd);
+      g_unix_fd = -1;
+    }
+  }
+  if (g_unix_fd >= 0) {
+    chmod(unix_path, 0666); // the SDR app usually is not root
+    lev.data.ptr = &g_unix_fd;
+    epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_unix_fd, &lev);
+  }
+
+  // Shared state block. Never unlinked, so readers that mapped it keep a
+  // valid mapping across daemon restarts (a stale heartbeat tells them).
+  int shm_fd = shm_open(SBITX_SHM_NAME, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  if (shm_fd >= 0 && ftruncate(shm_fd, sizeof(struct sbitx_shm)) == 0) {
+    void *p = mmap(NULL, sizeof(struct sbitx_shm), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (p != MAP_FAILED) {
+      g_shm = p;
+      // A daemon killed inside sbitx_shm_write() leaves seq odd, which
+      // readers would take as an update that never ends: start it even.
+      __atomic_store_n(&g_shm->seq, 0, __ATOMIC_RELEASE);
+      g_shm->magic = SBITX_SHM_MAGIC;
+    }
+  }
+  if (shm_fd >= 0)
+    close(shm_fd);
+  if (!g_shm)
+    perror("shm " SBITX_SHM_NAME);
+
+  // Start in RX
+  do_set_ptt(0);
+  // Set initial freq
+  do_set_freq(g_freq_hz);
+
+  printf("sbitx_ctrl listening on 127.0.0.1:%d%s%s\n", SBITX_TCP_PORT,
+         g_unix_fd >= 0 ? " and " : "", g_unix_fd >= 0 ? unix_path : "");
   fflush(stdout);
 
+  uint64_t next_beat = now_ms() + SUB_HEARTBEAT_MS;
+  struct epoll_event events[MAX_EVENTS];
+
   while (!g_shutdown) {
-    int fd = accept(listen_fd, NULL, NULL);
-    if (fd < 0) {
+    uint64_t now = now_ms();
+    if (now >= next_beat) {
+      broadcast_state();
+      next_beat = now + SUB_HEARTBEAT_MS;
+    }
+
+    int n = epoll_wait(g_epfd, events, MAX_EVENTS, (int)(next_beat - now));
+    if (n < 0) {
       if (errno == EINTR)
         continue;
-      perror("accept");
-      continue;
+      perror("epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &g_tcp_fd || ptr == &g_unix_fd) {
+        accept_all(*(int *)ptr);
+        continue;
+      }
+      struct conn *c = ptr;
+      if (c->dead)
+        continue;
+
+      uint32_t ev = events[i].events;
+      bool ok = true;
+      if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        ok = conn_read(c); // sees the EOF / error itself
+      else if (ev & EPOLLOUT)
+        ok = conn_flush(c);
+      if (!ok)
+        c->dead = true;
     }
-    pthread_t th;
-    pthread_create(&th, NULL, client_thread, (void *)(intptr_t)fd);
-    pthread_detach(th);
+    reap_conns(false);
   }
 
-  close(listen_fd);
+  reap_conns(true);
+  close(g_epfd);
+  close(g_tcp_fd);
+  if (g_unix_fd >= 0) {
+    close(g_unix_fd);
+    unlink(unix_path);
+  }
 
   // Always leave radio in RX
   do_set_ptt(0);
   hw_shutdown(&g_radio);
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,85 @@
+/* sbitx_ctrl.h - wire formats shared by sbitx_ctrl and the Soapy driver
+ *
+ * Plain C so both sides can include it. Both ends always run on the same
+ * Pi, so frames and the shared-memory block use native byte order.
+ */
+
+#ifndef SBITX_CTRL_H
+#define SBITX_CTRL_H
+
+#include <stdint.h>
+
+#define SBITX_TCP_PORT 9999
+#define SBITX_UNIX_PATH "/run/sbitx.sock"
+#define SBITX_SHM_NAME "/sbitx_ctrl"
+
+/* Binary framing, accepted on any connection next to the text protocol: a
+ * message starting with SBITX_FRAME_MAGIC (never a text command) is one
+ * fixed-size frame. The reply is a frame with the same op, status set and
+ * value holding the frequency / PTT state. */
+#define SBITX_FRAME_MAGIC 0xB5
+
+enum {
+  SBITX_OP_GET_FREQ = 'f',
+  SBITX_OP_SET_FREQ = 'F',
+  SBITX_OP_GET_PTT = 't',
+  SBITX_OP_SET_PTT = 'T',
+};
+
+enum {
+  SBITX_ST_OK = 0,
+  SBITX_ST_ERR = 1,
+};
+
+struct sbitx_frame {
+  uint8_t magic;  /* SBITX_FRAME_MAGIC */
+  uint8_t op;     /* SBITX_OP_* */
+  uint8_t status; /* SBITX_ST_* in replies, 0 in requests */
+  uint8_t reserved;
+  uint32_t value;
+};
+
+/* Current radio state, published by sbitx_ctrl in POSIX shared memory
+ * (SBITX_SHM_NAME). seq is a seqlock: odd while an update is in progress.
+ * heartbeat_ms (CLOCK_MONOTONIC) is refreshed on every change and at least
+ * once a second, so readers can tell a live daemon from a dead one. */
+#define SBITX_SHM_MAGIC 0x58544253u /* "SBTX" */
+
+struct sbitx_shm {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t freq_hz;
+  uint32_t ptt;
+  uint64_t heartbeat_ms;
+};
+
+static inline void sbitx_shm_write(struct sbitx_shm *s, uint32_t freq_hz,
+                                   uint32_t ptt, uint64_t heartbeat_ms) {
+  uint32_t q = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->seq, q + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&s->freq_hz, freq_hz, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->ptt, ptt, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->heartbeat_ms, heartbeat_ms, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->seq, q + 2, __ATOMIC_RELEASE);
+}
+
+/* Consistent snapshot without locks or syscalls; 0 if the writer kept
+ * the block busy for every attempt. */
+static inline int sbitx_shm_read(const struct sbitx_shm *s, uint32_t *freq_hz,
+                                 uint32_t *ptt, uint64_t *heartbeat_ms) {
+  for (int tries = 0; tries < 64; tries++) {
+    uint32_t q = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if (q & 1)
+      continue;
+    *freq_hz = __atomic_load_n(&s->freq_hz, __ATOMIC_RELAXED);
+    *ptt = __atomic_load_n(&s->ptt, __ATOMIC_RELAXED);
+    *heartbeat_ms = __atomic_load_n(&s->heartbeat_ms, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == q)
+      return 1;
+  }
+  return 0;
+}
+
+#endif
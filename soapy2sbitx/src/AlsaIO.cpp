@@ -0,0 +1,339 @@
+#include "AlsaIO.hpp"
+
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+static long long monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// snd_pcm_recover, plus the explicit restart an mmap capture needs
+// (readi starts the stream by itself, mmap_begin/commit do not).
+static int xrunRecover(snd_pcm_t *pcm, int err, bool restart)
+{
+    err = snd_pcm_recover(pcm, err, 1);
+    if (err >= 0 && restart) err = snd_pcm_start(pcm);
+    return err;
+}
+
+// Opens and configures an S32_LE stereo PCM. Returns null (logged) on
+// failure; *mmap says which access the device accepted.
+static snd_pcm_t *openPcm(const std::string &dev, snd_pcm_stream_t dir, AudioConfig &cfg, bool *mmap)
+{
+    const char *what = dir == SND_PCM_STREAM_CAPTURE ? "CAP" : "PB";
+
+    snd_pcm_t *pcm = nullptr;
+    int rc = snd_pcm_open(&pcm, dev.c_str(), dir, 0);
+    if (rc < 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_open %s failed: %s", what, snd_strerror(rc));
+        return nullptr;
+    }
+
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(pcm, hw);
+
+    *mmap = false;
+    if (cfg.mmap)
+    {
+        rc = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        if (rc == 0)
+            *mmap = true;
+        else
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX %s: mmap access not supported (%s), using rw",
+                           what, snd_strerror(rc));
+    }
+    if (!*mmap) snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S32_LE);
+    snd_pcm_hw_params_set_channels(pcm, hw, 2);
+
+    unsigned int rate = cfg.rate;
+    snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, nullptr);
+
+    snd_pcm_uframes_t period = cfg.periodFrames;
+    snd_pcm_uframes_t buffer = cfg.bufferFrames;
+    snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, nullptr);
+    snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer);
+
+    rc = snd_pcm_hw_params(pcm, hw);
+    if (rc < 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_hw_params %s failed: %s", what, snd_strerror(rc));
+        snd_pcm_close(pcm);
+        return nullptr;
+    }
+    cfg.periodFrames = period;
+    cfg.bufferFrames = buffer;
+    return pcm;
+}
+
+// ------------------- capture -------------------
+
+std::unique_ptr<AlsaCapture> AlsaCapture::open(const std::string &dev, AudioConfig &cfg)
+{
+    std::unique_ptr<AlsaCapture> c(new AlsaCapture);
+    c->pcm_ = openPcm(dev, SND_PCM_STREAM_CAPTURE, cfg, &c->mmap_);
+    if (!c->pcm_) return nullptr;
+
+    // Timestamp period updates on CLOCK_MONOTONIC, for firstFrameNs
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(c->pcm_, sw);
+    snd_pcm_sw_params_set_tstamp_mode(c->pcm_, sw, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(c->pcm_, sw, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    const int rc = snd_pcm_sw_params(c->pcm_, sw);
+    if (rc < 0)
+        SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX CAP: no timestamps (%s), using snd_pcm_delay", snd_strerror(rc));
+
+    snd_pcm_prepare(c->pcm_);
+    c->rate_ = cfg.rate;
+    c->period_ = cfg.periodFrames;
+    if (!c->mmap_) c->buf_.assign(c->period_ * 2, 0);
+    return c;
+}
+
+AlsaCapture::~AlsaCapture()
+{
+    if (!pcm_) return;
+    snd_pcm_drop(pcm_);
+    snd_pcm_close(pcm_);
+}
+
+int AlsaCapture::recover(int err)
+{
+    if (err == -EPIPE) xruns_++;
+    return xrunRecover(pcm_, err, mmap_);
+}
+
+bool AlsaCapture::begin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count)
+{
+    count_ = 0;
+    maxFrames = std::min(maxFrames, period_);
+    if (mmap_) return mmapBegin(maxFrames, frames, stride, count);
+
+    const snd_pcm_sframes_t rd = snd_pcm_readi(pcm_, buf_.data(), maxFrames);
+    if (rd < 0)
+    {
+        const int rc = recover((int)rd);
+        if (rc < 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "RX snd_pcm_readi recover failed: %s", snd_strerror(rc));
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return false;
+    }
+
+    frames = buf_.data();
+    stride = 2;
+    count = count_ = (size_t)rd;
+    return count > 0;
+}
+
+bool AlsaCapture::mmapBegin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count)
+{
+    if (snd_pcm_state(pcm_) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start(pcm_);
+
+    const snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_);
+    if (avail < 0)
+    {
+        if (recover((int)avail) < 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return false;
+    }
+    if ((size_t)avail < maxFrames)
+    {
+        // Sleeps in poll() until a period is ready, like readi would.
+        const int rc = snd_pcm_wait(pcm_, 1000);
+        if (rc < 0) recover(rc);
+        return false;
+    }
+
+    const snd_pcm_channel_area_t *areas = nullptr;
+    snd_pcm_uframes_t n = maxFrames;
+    const int rc = snd_pcm_mmap_begin(pcm_, &areas, &mmapOffset_, &n);
+    if (rc < 0)
+    {
+        recover(rc);
+        return false;
+    }
+
+    // Interleaved S32 stereo: channel 0 at `first`, one frame every `step` bits.
+    stride = areas[0].step / 32;
+    frames = reinterpret_cast<const int32_t *>(
+                 static_cast<const uint8_t *>(areas[0].addr) + areas[0].first / 8) + mmapOffset_ * stride;
+    count = count_ = (size_t)n;
+    return n > 0;
+}
+
+void AlsaCapture::end()
+{
+    // Hand the DMA area back only once the DSP is done reading it
+    if (!mmap_ || !count_) return;
+    const snd_pcm_sframes_t c = snd_pcm_mmap_commit(pcm_, mmapOffset_, count_);
+    if (c < 0 || (size_t)c != count_)
+        recover(c < 0 ? (int)c : -EPIPE);
+    count_ = 0;
+}
+
+long long AlsaCapture::firstFrameNs()
+{
+    // Frames of the last period already taken from the buffer (RW) are
+    // behind the application pointer; mmap has not committed them yet.
+    const size_t behind = mmap_ ? 0 : count_;
+
+    // htimestamp: `avail` frames were waiting when the hardware pointer
+    // moved at ts. Without driver timestamps, the delay as of now.
+    snd_pcm_uframes_t avail = 0;
+    snd_htimestamp_t ts{};
+    long long atNs;
+    long long queued;
+    if (snd_pcm_htimestamp(pcm_, &avail, &ts) == 0 && (ts.tv_sec || ts.tv_nsec))
+    {
+        atNs = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        queued = (long long)avail;
+    }
+    else
+    {
+        snd_pcm_sframes_t d = 0;
+        if (snd_pcm_delay(pcm_, &d) < 0) d = 0;
+        atNs = monotonicNs();
+        queued = (long long)d;
+    }
+    return atNs - (long long)((double)(queued + (long long)behind) * 1e9 / rate_);
+}
+
+// ------------------- playback -------------------
+
+std::unique_ptr<AlsaPlayback> AlsaPlayback::open(const std::string &dev, AudioConfig &cfg)
+{
+    std::unique_ptr<AlsaPlayback> p(new AlsaPlayback);
+    p->pcm_ = openPcm(dev, SND_PCM_STREAM_PLAYBACK, cfg, &p->mmap_);
+    if (!p->pcm_) return nullptr;
+
+    snd_pcm_prepare(p->pcm_);
+    p->rate_ = cfg.rate;
+    p->period_ = cfg.periodFrames;
+    p->bufferFrames_ = cfg.bufferFrames;
+    if (!p->mmap_) p->buf_.assign(p->period_ * 2, 0);
+    return p;
+}
+
+AlsaPlayback::~AlsaPlayback()
+{
+    if (!pcm_) return;
+    snd_pcm_drop(pcm_);
+    snd_pcm_close(pcm_);
+}
+
+int AlsaPlayback::recover(int err)
+{
+    if (err == -EPIPE) xruns_++;
+    return xrunRecover(pcm_, err, false);
+}
+
+bool AlsaPlayback::write(size_t frames, FrameRenderer &r)
+{
+    return mmap_ ? writeMmap(frames, r) : writeRw(frames, r);
+}
+
+long long AlsaPlayback::queuedNs()
+{
+    snd_pcm_sframes_t d = 0;
+    if (snd_pcm_delay(pcm_, &d) < 0 || d < 0) return 0; // stopped or underrun
+    return (long long)((double)d * 1e9 / rate_);
+}
+
+bool AlsaPlayback::writeRw(size_t frames, FrameRenderer &r)
+{
+    for (size_t done = 0; done < frames;)
+    {
+        const size_t n = std::min(frames - done, period_);
+        r.render(done, n, buf_.data(), 2);
+
+        size_t written = 0;
+        while (written < n)
+        {
+            const snd_pcm_sframes_t rc = snd_pcm_writei(pcm_, buf_.data() + written * 2, n - written);
+
+            if (rc == -EAGAIN)
+            {
+                snd_pcm_wait(pcm_, 100);
+                continue;
+            }
+
+            if (rc < 0)
+            {
+                if (recover((int)rc) < 0)
+                    return false;
+                continue;
+            }
+
+            written += (size_t)rc;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// Renders straight into the playback DMA area.
+bool AlsaPlayback::writeMmap(size_t frames, FrameRenderer &r)
+{
+    size_t done = 0;
+
+    while (done < frames)
+    {
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_);
+        if (avail < 0)
+        {
+            if (recover((int)avail) < 0) return false;
+            continue;
+        }
+        if (avail == 0)
+        {
+            // Buffer full: make sure it is draining, then sleep until a period frees up.
+            if (snd_pcm_state(pcm_) == SND_PCM_STATE_PREPARED) snd_pcm_start(pcm_);
+            const int rc = snd_pcm_wait(pcm_, 100);
+            if (rc < 0 && recover(rc) < 0) return false;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas = nullptr;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t n = std::min<snd_pcm_uframes_t>(frames - done, (snd_pcm_uframes_t)avail);
+        int rc = snd_pcm_mmap_begin(pcm_, &areas, &offset, &n);
+        if (rc < 0)
+        {
+            if (recover(rc) < 0) return false;
+            continue;
+        }
+
+        const size_t stride = areas[0].step / 32;
+        int32_t *dst = reinterpret_cast<int32_t *>(
+                           static_cast<uint8_t *>(areas[0].addr) + areas[0].first / 8) + offset * stride;
+        r.render(done, n, dst, stride);
+
+        // A short commit still played its first c frames: keep them, and
+        // only the rest goes round again.
+        const snd_pcm_sframes_t c = snd_pcm_mmap_commit(pcm_, offset, n);
+        if (c > 0) done += (size_t)c;
+        if (c < 0 || (snd_pcm_uframes_t)c != n)
+        {
+            if (recover(c < 0 ? (int)c : -EPIPE) < 0) return false;
+            continue;
+        }
+
+        if (snd_pcm_state(pcm_) == SND_PCM_STATE_PREPARED &&
+            snd_pcm_avail_update(pcm_) <= (snd_pcm_sframes_t)(bufferFrames_ - period_))
+            snd_pcm_start(pcm_);
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "AudioIO.hpp"
+
+#include <alsa/asoundlib.h>
+
+#include <vector>
+
+// The WM8731 (or any S32_LE stereo PCM) through ALSA, RW or mmap access.
+//
+// RW copies each period into a buffer of ours; mmap hands the DSP the DMA
+// area itself and only commits it back in end() / after rendering.
+
+class AlsaCapture : public CaptureSource
+{
+public:
+    ~AlsaCapture() override;
+
+    // Null (logged) when the device will not open as asked.
+    static std::unique_ptr<AlsaCapture> open(const std::string &dev, AudioConfig &cfg);
+
+    bool begin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count) override;
+    void end() override;
+    long long firstFrameNs() override;
+    bool mmap() const override { return mmap_; }
+
+private:
+    AlsaCapture() = default;
+    bool mmapBegin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count);
+    int recover(int err);
+
+    snd_pcm_t *pcm_ = nullptr;
+    bool mmap_ = false;
+    unsigned rate_ = 96000;
+    size_t period_ = 0;
+    std::vector<int32_t> buf_; // RW periods
+
+    // Last begin()
+    snd_pcm_uframes_t mmapOffset_ = 0;
+    size_t count_ = 0;
+};
+
+class AlsaPlayback : public PlaybackSink
+{
+public:
+    ~AlsaPlayback() override;
+
+    static std::unique_ptr<AlsaPlayback> open(const std::string &dev, AudioConfig &cfg);
+
+    bool write(size_t frames, FrameRenderer &r) override;
+    long long queuedNs() override;
+    bool mmap() const override { return mmap_; }
+
+private:
+    AlsaPlayback() = default;
+    bool writeRw(size_t frames, FrameRenderer &r);
+    bool writeMmap(size_t frames, FrameRenderer &r);
+    int recover(int err);
+
+    snd_pcm_t *pcm_ = nullptr;
+    bool mmap_ = false;
+    unsigned rate_ = 96000;
+    size_t period_ = 0;
+    size_t bufferFrames_ = 0;
+    std::vector<int32_t> buf_; // RW: one period rendered at a time
+};
@@ -0,0 +1,22 @@
+#include "AudioIO.hpp"
+#include "AlsaIO.hpp"
+#include "FileIO.hpp"
+
+static bool startsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+std::unique_ptr<CaptureSource> openCaptureSource(const std::string &spec, AudioConfig &cfg)
+{
+    if (startsWith(spec, "file:")) return FileCapture::open(spec.substr(5), cfg);
+    if (startsWith(spec, "synth")) return SynthCapture::open(spec.substr(spec.size() > 5 ? 6 : 5), cfg);
+    return AlsaCapture::open(spec, cfg);
+}
+
+std::unique_ptr<PlaybackSink> openPlaybackSink(const std::string &spec, AudioConfig &cfg)
+{
+    if (startsWith(spec, "file:")) return FileSink::open(spec.substr(5), true, cfg);
+    if (startsWith(spec, "null")) return FileSink::open(spec.substr(4), false, cfg);
+    return AlsaPlayback::open(spec, cfg);
+}
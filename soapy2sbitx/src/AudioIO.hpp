@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Where RX frames come from and TX frames go.
+//
+// Frames are S32_LE stereo throughout: on capture left is the IF and right
+// the mic, on playback right is the TX IF and left is silent. The ALSA
+// backends (AlsaIO.cpp) drive the codec; FileIO.cpp replays a recording,
+// generates a test signal or writes TX to a file, so the driver can be
+// load- and regression-tested without the radio.
+//
+// Each backend is used by one thread at a time (RX or TX thread).
+
+struct AudioConfig
+{
+    unsigned rate = 96000;
+    bool mmap = false;           // ALSA: ask for mmap access
+    size_t periodFrames = 1000;  // in: requested, out: what the device took
+    size_t bufferFrames = 4000;
+    double ifHz = 24000.0;       // synth: tone= is an offset from the IF
+};
+
+class CaptureSource
+{
+public:
+    virtual ~CaptureSource() = default;
+
+    // Waits for the next period and points `frames` at `count` of them
+    // (at most maxFrames, `stride` ints apart). False when nothing arrived
+    // this time (an overrun was recovered, say); just call again.
+    virtual bool begin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count) = 0;
+
+    // Done with the frames from begin(); they may be overwritten now.
+    virtual void end() {}
+
+    // When the first frame from the last begin() was sampled, monotonic ns.
+    virtual long long firstFrameNs() = 0;
+
+    // Overruns since the last call (frames lost before they were read).
+    unsigned long long takeXruns()
+    {
+        const unsigned long long x = xruns_;
+        xruns_ = 0;
+        return x;
+    }
+
+    virtual bool mmap() const { return false; }
+
+protected:
+    unsigned long long xruns_ = 0;
+};
+
+// Fills playback frames in place, so a sink can hand out device memory.
+class FrameRenderer
+{
+public:
+    // Frames [first, first + n) of the write, `stride` ints apart.
+    virtual void render(size_t first, size_t n, int32_t *dst, size_t stride) = 0;
+
+protected:
+    ~FrameRenderer() = default;
+};
+
+class PlaybackSink
+{
+public:
+    virtual ~PlaybackSink() = default;
+
+    // Plays `frames` frames, blocking while the device is full. False on
+    // an error the sink could not recover from.
+    virtual bool write(size_t frames, FrameRenderer &r) = 0;
+
+    // How long until a frame written now is heard.
+    virtual long long queuedNs() = 0;
+
+    // Underruns since the last call (the device ran dry).
+    unsigned long long takeXruns()
+    {
+        const unsigned long long x = xruns_;
+        xruns_ = 0;
+        return x;
+    }
+
+    virtual bool mmap() const { return false; }
+
+protected:
+    unsigned long long xruns_ = 0;
+};
+
+// spec: an ALSA device ("hw:0,0"), "file:<path>[;fast][;loop]" or
+// "synth:[tone=Hz][;level=dBFS][;noise=dBFS][;fast]". Logs and returns null
+// on failure. cfg.periodFrames / bufferFrames come back as opened.
+std::unique_ptr<CaptureSource> openCaptureSource(const std::string &spec, AudioConfig &cfg);
+
+// spec: an ALSA device, "file:<path>[;fast]" or "null[;fast]".
+std::unique_ptr<PlaybackSink> openPlaybackSink(const std::string &spec, AudioConfig &cfg);
@@ -0,0 +1,220 @@
+#include "Channelizer.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Sub-receiver rings hold this much at the channel rate.
+static const unsigned kSubRingSeconds = 2;
+
+// Written out: std::complex<float>::operator* carries NaN/Inf fix-ups.
+static inline std::complex<float> cmul(std::complex<float> a, std::complex<float> b)
+{
+    return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(),
+                               a.real() * b.imag() + a.imag() * b.real());
+}
+
+PolyphaseChannelizer::PolyphaseChannelizer(unsigned bins, unsigned tapsPerBranch)
+{
+    m_ = validBins(bins) ? bins : 16;
+    len_ = (size_t)m_ * std::max(2u, tapsPerBranch);
+
+    // Prototype lowpass: Kaiser-windowed sinc with its -6 dB point at one
+    // bin spacing, so the passband reaches 3/4 of it and the stopband
+    // starts before the 2x-oversampled output folds back in. Unity DC gain.
+    const double fc = 1.0 / (double)m_;
+    const double beta = 8.0; // ~-80 dB sidelobes
+    const double c = (double)(len_ - 1) / 2.0;
+    std::vector<double> h(len_);
+    double sum = 0.0;
+    for (size_t i = 0; i < len_; i++)
+    {
+        const double x = (double)i - c;
+        const double r = x / c;
+        const double w = sbitx::besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / sbitx::besselI0(beta);
+        h[i] = (x == 0.0 ? 2.0 * fc : std::sin(2.0 * M_PI * fc * x) / (M_PI * x)) * w;
+        sum += h[i];
+    }
+    coef_.resize(len_);
+    for (size_t i = 0; i < len_; i++) coef_[len_ - 1 - i] = (float)(h[i] / sum);
+
+    re_.assign(2 * len_, 0.0f);
+    im_.assign(2 * len_, 0.0f);
+
+    twiddle_.resize(m_ / 2);
+    for (unsigned k = 0; k < m_ / 2; k++)
+        twiddle_[k] = std::polar(1.0f, (float)(2.0 * M_PI * k / m_));
+
+    unsigned lg = 0;
+    while ((1u << lg) < m_) lg++;
+    bitrev_.resize(m_);
+    for (unsigned i = 0; i < m_; i++)
+    {
+        unsigned r = 0;
+        for (unsigned b = 0; b < lg; b++)
+            if (i & (1u << b)) r |= 1u << (lg - 1 - b);
+        bitrev_[i] = r;
+    }
+    fold_.resize(m_);
+}
+
+// In place, e^{+j} kernel (an unscaled inverse DFT): bin k comes out at
+// +k * fs / m_.
+void PolyphaseChannelizer::fft(std::complex<float> *x) const
+{
+    for (unsigned i = 0; i < m_; i++)
+        if (i < bitrev_[i]) std::swap(x[i], x[bitrev_[i]]);
+
+    for (unsigned len = 2; len <= m_; len <<= 1)
+    {
+        const unsigned half = len / 2, step = m_ / len;
+        for (unsigned i = 0; i < m_; i += len)
+        {
+            for (unsigned k = 0; k < half; k++)
+            {
+                const std::complex<float> u = x[i + k];
+                const std::complex<float> v = cmul(x[i + k + half], twiddle_[k * step]);
+                x[i + k] = u + v;
+                x[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+size_t PolyphaseChannelizer::process(const std::complex<float> *in, size_t n, std::complex<float> *out)
+{
+    const unsigned d = decim();
+    size_t frames = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        re_[pos_] = re_[pos_ + len_] = in[i].real();
+        im_[pos_] = im_[pos_ + len_] = in[i].imag();
+        const size_t w = pos_ + 1;
+        pos_ = (pos_ + 1 == len_) ? 0 : pos_ + 1;
+        if (++fill_ < d) continue;
+        fill_ = 0;
+
+        // Window times prototype, folded modulo m_: history sample j
+        // (oldest first) lands on branch (len_ - 1 - j) % m_.
+        const float *wr = &re_[w];
+        const float *wi = &im_[w];
+        std::fill(fold_.begin(), fold_.end(), std::complex<float>(0.0f, 0.0f));
+        for (size_t base = len_; base >= m_; base -= m_)
+        {
+            for (unsigned m = 0; m < m_; m++)
+            {
+                const size_t j = base - 1 - m;
+                fold_[m] += std::complex<float>(coef_[j] * wr[j], coef_[j] * wi[j]);
+            }
+        }
+
+        fft(fold_.data());
+
+        // Decimating by m_ / 2 leaves every odd bin rotated by pi on odd
+        // frames.
+        std::complex<float> *y = out + frames * m_;
+        for (unsigned k = 0; k < m_; k++) y[k] = (odd_ && (k & 1)) ? -fold_[k] : fold_[k];
+        odd_ = !odd_;
+        frames++;
+    }
+    return frames;
+}
+
+// ------------------- sub-receivers -------------------
+
+void SubReceivers::configure(unsigned bins, unsigned fs, size_t maxIn)
+{
+    fs_ = fs;
+    pfb_ = PolyphaseChannelizer(bins);
+    maxIn_ = std::max<size_t>(maxIn, pfb_.decim());
+    frames_.assign(pfb_.maxFrames(maxIn_) * bins, std::complex<float>(0.0f, 0.0f));
+    out_.assign(pfb_.maxFrames(maxIn_), std::complex<float>(0.0f, 0.0f));
+}
+
+int SubReceivers::open(double offsetHz)
+{
+    const double spacing = (double)fs_ / bins();
+    const long nearest = std::lround(offsetHz / spacing);
+
+    for (unsigned i = 0; i < kMaxSlots; i++)
+    {
+        Slot &s = slots_[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.open) continue;
+
+        s.open = true;
+        s.active = false;
+        s.offsetHz = offsetHz;
+        s.bin = (unsigned)(((nearest % (long)bins()) + bins()) % bins());
+        s.nco.setFrequency(offsetHz - nearest * spacing, rate());
+        s.ring.reset(rate() * kSubRingSeconds, sizeof(std::complex<float>));
+        return (int)i;
+    }
+    return -1;
+}
+
+void SubReceivers::close(int slot)
+{
+    std::lock_guard<std::mutex> lock(slots_[slot].mutex);
+    slots_[slot].open = false;
+}
+
+IQRing::Reader SubReceivers::start(int slot)
+{
+    Slot &s = slots_[slot];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!s.active)
+    {
+        // Same size as at open(): no reallocation
+        s.ring.reset(rate() * kSubRingSeconds, sizeof(std::complex<float>));
+        s.nco.setPhase(0);
+        s.active = true;
+        active_.fetch_add(1);
+    }
+    return s.ring.attach();
+}
+
+void SubReceivers::stop(int slot, IQRing::Reader &rd)
+{
+    Slot &s = slots_[slot];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.active)
+    {
+        s.active = false;
+        active_.fetch_sub(1);
+    }
+    s.ring.detach(rd);
+}
+
+void SubReceivers::process(const std::complex<float> *in, size_t n)
+{
+    if (!running()) return;
+
+    // Never allocates: a call larger than configure() planned for is cut
+    // into pieces that fit the scratch.
+    for (size_t done = 0; done < n;)
+    {
+        const size_t k = std::min(n - done, maxIn_);
+        processChunk(in + done, k);
+        done += k;
+    }
+}
+
+void SubReceivers::processChunk(const std::complex<float> *in, size_t n)
+{
+    const unsigned m = bins();
+    const size_t f = pfb_.process(in, n, frames_.data());
+    if (!f) return;
+
+    for (unsigned i = 0; i < kMaxSlots; i++)
+    {
+        Slot &s = slots_[i];
+        std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || !s.active) continue;
+
+        // z * e^{-j ph}: the residual offset down to DC
+        for (size_t k = 0; k < f; k++)
+            out_[k] = cmul(frames_[k * m + s.bin], std::conj(s.nco.next()));
+        s.ring.write(out_.data(), f);
+    }
+}
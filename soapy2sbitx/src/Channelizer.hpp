@@ -0,0 +1,117 @@
+#pragma once
+
+#include "IQRing.hpp"
+#include "NCO.hpp"
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Polyphase FFT analysis filterbank: complex baseband at fs -> `bins`
+// channels centred k * fs / bins apart (bin k, the upper half being the
+// negative frequencies), each decimated by bins / 2.
+//
+// Oversampled by two, so each channel is flat to 3/4 of the bin spacing and
+// neighbours overlap: any band up to half the spacing wide fits inside one
+// bin whole. Per output frame: one bins x taps-per-branch multiply-add over
+// the history, folded into `bins` sums, and one FFT for all channels.
+class PolyphaseChannelizer
+{
+public:
+    static constexpr unsigned kTapsPerBranch = 12;
+
+    // bins: a power of two, at least 4.
+    explicit PolyphaseChannelizer(unsigned bins = 16, unsigned tapsPerBranch = kTapsPerBranch);
+
+    static bool validBins(unsigned bins) { return bins >= 4 && bins <= 256 && !(bins & (bins - 1)); }
+
+    unsigned bins() const { return m_; }
+    unsigned decim() const { return m_ / 2; }
+
+    // Upper bound on frames for n inputs.
+    size_t maxFrames(size_t n) const { return n / decim() + 1; }
+
+    // Writes frames of bins() samples to out (frame f, bin k at
+    // out[f * bins() + k]). Returns frames written. Never allocates.
+    size_t process(const std::complex<float> *in, size_t n, std::complex<float> *out);
+
+private:
+    void fft(std::complex<float> *x) const;
+
+    unsigned m_ = 0;
+    size_t len_ = 0;               // m_ * taps per branch
+    std::vector<float> coef_;      // len_, oldest first
+    std::vector<float> re_, im_;   // 2 * len_ mirrored history
+    size_t pos_ = 0;
+    unsigned fill_ = 0;            // inputs since the last frame
+    bool odd_ = false;             // frame parity: odd frames flip odd bins
+
+    std::vector<std::complex<float>> twiddle_; // e^{+j 2 pi k / m_}, k < m_ / 2
+    std::vector<unsigned> bitrev_;
+    std::vector<std::complex<float>> fold_;
+};
+
+// Narrow sub-receivers (stream arg sub=) fed from channel 0 at the
+// decimator rate by one channelizer in the RX thread.
+//
+// Each open slot takes the bin nearest its offset and shifts the rest of
+// the way with its own NCO, so the offset lands at DC, then writes its own
+// ring. The channelizer does not run while no slot is active. The RX thread
+// only ever try_locks a slot; a slot busy (being opened, started, stopped)
+// skips that period.
+class SubReceivers
+{
+public:
+    static constexpr unsigned kMaxSlots = 8;
+
+    // While no slot is active (the RX thread is not feeding it). Allocates,
+    // with scratch for maxIn inputs per process() call; larger calls are
+    // split.
+    void configure(unsigned bins, unsigned fs, size_t maxIn = 0);
+
+    unsigned bins() const { return pfb_.bins(); }
+    unsigned rate() const { return 2 * fs_ / pfb_.bins(); }
+    bool running() const { return active_.load(std::memory_order_relaxed) > 0; }
+
+    // Any thread. Returns the slot, -1 when all are taken. Allocates.
+    int open(double offsetHz);
+    void close(int slot);
+
+    // Any thread. start() returns the slot's reader (ring emptied first).
+    IQRing::Reader start(int slot);
+    void stop(int slot, IQRing::Reader &rd);
+
+    double offsetHz(int slot) const { return slots_[slot].offsetHz; }
+    unsigned bin(int slot) const { return slots_[slot].bin; }
+
+    // RX thread: channel 0 at fs. Never allocates.
+    void process(const std::complex<float> *in, size_t n);
+
+private:
+    void processChunk(const std::complex<float> *in, size_t n);
+
+    struct Slot
+    {
+        std::mutex mutex; // process() only try_locks
+        bool open = false;
+        bool active = false;
+        double offsetHz = 0.0;
+        unsigned bin = 0;
+        NCO nco;          // residual: offset - bin centre, at rate()
+        IQRing ring;
+    };
+
+    unsigned fs_ = 48000;
+    PolyphaseChannelizer pfb_;
+    std::unique_ptr<Slot[]> slots_{new Slot[kMaxSlots]};
+    std::atomic<int> active_{0};
+
+    // RX thread (sized by configure)
+    size_t maxIn_ = 0;
+    std::vector<std::complex<float>> frames_;
+    std::vector<std::complex<float>> out_;
+};
@@ -0,0 +1,510 @@
+#include "CtrlClient.hpp"
+
+#include "sbitx_ctrl.h"
+
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// A reply slower than this means the link is wedged; drop and reconnect.
+static const int kReplyTimeoutMs = 1000;
+
+// Watch thread back-off between subscription / shm attempts.
+static const int kResubscribeMs = 500;
+
+// steady_clock is CLOCK_MONOTONIC, the clock sbitx_ctrl stamps shm with.
+static long long monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CtrlClient::CtrlClient(const std::string &host, int port, const ThreadProfile &tp)
+    : host_(host), port_(port), tp_(tp)
+{
+    start();
+}
+
+CtrlClient::CtrlClient(const std::string &unixPath, const ThreadProfile &tp)
+    : unixPath_(unixPath), tp_(tp)
+{
+    start();
+}
+
+void CtrlClient::start()
+{
+    thread_ = std::thread(&CtrlClient::threadMain, this);
+    watchThread_ = std::thread(&CtrlClient::watchMain, this);
+}
+
+CtrlClient::~CtrlClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        // The watch thread sits in a read that only a heartbeat (or
+        // kStaleMs) would end; make it return now.
+#ifdef __linux__
+        if (watchFd_ >= 0) shutdown(watchFd_, SHUT_RDWR);
+#endif
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    if (watchThread_.joinable()) watchThread_.join();
+
+#ifdef __linux__
+    if (const sbitx_shm *shm = shm_.load())
+        munmap(const_cast<sbitx_shm *>(shm), sizeof(sbitx_shm));
+#endif
+}
+
+void CtrlClient::setFrequency(long long hz)
+{
+    Request r;
+    r.op = SBITX_OP_SET_FREQ;
+    r.value = hz;
+    wantHz_.store(hz);
+    enqueue(std::move(r));
+}
+
+void CtrlClient::setPTT(bool on)
+{
+    Request r;
+    r.op = SBITX_OP_SET_PTT;
+    r.value = on ? 1 : 0;
+    enqueue(std::move(r));
+}
+
+bool CtrlClient::query(char op, long long &value, long timeoutUs)
+{
+    Request r;
+    r.op = op;
+    r.reply = std::make_shared<std::promise<Reply>>();
+    std::future<Reply> f = r.reply->get_future();
+    enqueue(std::move(r));
+
+    if (f.wait_for(std::chrono::microseconds(std::max(0L, timeoutUs))) != std::future_status::ready)
+        return false;
+
+    const Reply rep = f.get();
+    if (!rep.ok) return false;
+    value = rep.value;
+    return true;
+}
+
+void CtrlClient::enqueue(Request r)
+{
+    r.queuedNs = monotonicNs();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Only the last frequency of a run that has not been sent matters.
+        if (r.op == SBITX_OP_SET_FREQ && !queue_.empty() && queue_.back().op == SBITX_OP_SET_FREQ)
+            queue_.back().value = r.value;
+        else
+            queue_.push_back(std::move(r));
+    }
+    cv_.notify_all(); // the watch thread shares cv_ for its back-off
+}
+
+void CtrlClient::dropWant(long long hz) const
+{
+    wantHz_.compare_exchange_strong(hz, -1);
+}
+
+bool CtrlClient::state(long long &hz, bool &ptt) const
+{
+    long long want = wantHz_.load(std::memory_order_relaxed);
+
+    if (const sbitx_shm *shm = shm_.load(std::memory_order_acquire))
+    {
+        uint32_t f = 0, p = 0;
+        uint64_t beatMs = 0;
+        if (!sbitx_shm_read(shm, &f, &p, &beatMs)) return false;
+        if (monotonicNs() / 1000000LL - (long long)beatMs > kStaleMs) return false;
+
+        // The daemon has caught up with what we asked for.
+        if (want == (long long)f)
+        {
+            dropWant(want);
+            want = -1;
+        }
+        hz = want >= 0 ? want : (long long)f;
+        ptt = p != 0;
+        return true;
+    }
+
+    const long long at = pushedNs_.load(std::memory_order_acquire);
+    if (at == 0 || monotonicNs() - at > (long long)kStaleMs * 1000000LL) return false;
+
+    const uint64_t v = pushed_.load(std::memory_order_relaxed);
+    hz = want >= 0 ? want : (long long)(v >> 1);
+    ptt = (v & 1) != 0;
+    return true;
+}
+
+std::string CtrlClient::encode(const Request &r) const
+{
+    if (!unixPath_.empty())
+    {
+        sbitx_frame f{};
+        f.magic = SBITX_FRAME_MAGIC;
+        f.op = (uint8_t)r.op;
+        f.value = r.value >= 0 ? (uint32_t)r.value : 0;
+        return std::string(reinterpret_cast<const char *>(&f), sizeof(f));
+    }
+
+    std::string line(1, r.op);
+    if (r.value >= 0) line += " " + std::to_string(r.value);
+    return line + "\n";
+}
+
+// One reply in the link's framing. `text` is what to show in a warning.
+bool CtrlClient::readReply(Reply &rep, std::string &text)
+{
+    if (!unixPath_.empty())
+    {
+        while (rxBuf_.size() < sizeof(sbitx_frame))
+            if (!fill(fd_, rxBuf_, kReplyTimeoutMs)) return false;
+
+        sbitx_frame f;
+        std::memcpy(&f, rxBuf_.data(), sizeof(f));
+        rxBuf_.erase(0, sizeof(f));
+        if (f.magic != SBITX_FRAME_MAGIC) return false;
+
+        rep.ok = f.status == SBITX_ST_OK;
+        rep.value = f.value;
+        text = rep.ok ? "OK" : "ERR";
+        return true;
+    }
+
+    if (!readLine(fd_, rxBuf_, text, kReplyTimeoutMs)) return false;
+
+    // "14056000" for queries, "OK 14056000" for commands, "ERR ..." on error
+    rep.ok = text.rfind("ERR", 0) != 0;
+    const char *p = text.c_str();
+    if (text.rfind("OK", 0) == 0) p += 2;
+    rep.value = std::atoll(p);
+    return true;
+}
+
+void CtrlClient::threadMain()
+{
+    sbitx::enterThread(tp_, "sbitx-ctrl");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (stop_) break;
+
+        std::deque<Request> batch;
+        batch.swap(queue_);
+        lock.unlock();
+
+        // Pipeline: write the whole batch, then collect replies in order.
+        // One retry covers a connection the server closed while idle.
+        size_t done = 0;
+        for (int attempt = 0; attempt < 2 && done < batch.size(); attempt++)
+        {
+            if (fd_ < 0)
+            {
+                fd_ = openLink();
+                rxBuf_.clear();
+                if (fd_ < 0) break;
+            }
+
+            std::string out;
+            for (size_t i = done; i < batch.size(); i++)
+                out += encode(batch[i]);
+            if (!sendAll(fd_, out))
+            {
+                closeLink();
+                continue;
+            }
+            const long long sentNs = monotonicNs();
+
+            for (; done < batch.size(); done++)
+            {
+                Reply rep{};
+                std::string text;
+                if (!readReply(rep, text))
+                {
+                    closeLink();
+                    break;
+                }
+
+                const Request &r = batch[done];
+                const long long nowNs = monotonicNs();
+                rtt_.record(nowNs - sentNs);
+                if (r.op == SBITX_OP_SET_PTT && rep.ok) pttLatency_.record(nowNs - r.queuedNs);
+                // Rejected: stop reading back a frequency that never took.
+                if (!rep.ok && r.op == SBITX_OP_SET_FREQ) dropWant(r.value);
+                if (rep.ok && r.op == SBITX_OP_SET_FREQ) freqApplied_.fetch_add(1, std::memory_order_release);
+                if (r.reply)
+                    r.reply->set_value(rep);
+                else if (!rep.ok)
+                    SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX ctrl: %c %lld -> %s",
+                                   r.op, r.value, text.c_str());
+            }
+        }
+
+        if (done < batch.size())
+        {
+            if (failures_++ == 0)
+                SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX ctrl: %s unreachable, %zu command(s) dropped",
+                               unixPath_.empty() ? (host_ + ":" + std::to_string(port_)).c_str() : unixPath_.c_str(),
+                               batch.size() - done);
+            for (size_t i = done; i < batch.size(); i++)
+            {
+                if (batch[i].reply) batch[i].reply->set_value({false, 0});
+                if (batch[i].op == SBITX_OP_SET_FREQ) dropWant(batch[i].value);
+            }
+        }
+        else if (failures_)
+        {
+            SoapySDR::log(SOAPY_SDR_INFO, "SBITX ctrl: reconnected");
+            failures_ = 0;
+        }
+
+        lock.lock();
+    }
+
+    for (auto &r : queue_)
+        if (r.reply) r.reply->set_value({false, 0});
+    queue_.clear();
+    lock.unlock();
+
+    closeLink();
+}
+
+void CtrlClient::watchMain()
+{
+    sbitx::enterThread(tp_, "sbitx-ctrlwatch");
+    if (unixPath_.empty())
+        watchSubscription();
+    else
+        watchShm();
+}
+
+// AF_UNIX: map the daemon's state block as soon as it exists. The daemon
+// never unlinks it, so one mapping stays valid across restarts.
+void CtrlClient::watchShm()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_)
+    {
+#ifdef __linux__
+        lock.unlock();
+        const int fd = shm_open(SBITX_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+        void *p = MAP_FAILED;
+        if (fd >= 0)
+        {
+            p = mmap(nullptr, sizeof(sbitx_shm), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+        }
+        if (p != MAP_FAILED)
+        {
+            const auto *shm = static_cast<const sbitx_shm *>(p);
+            if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) == SBITX_SHM_MAGIC)
+            {
+                shm_.store(shm, std::memory_order_release);
+                return;
+            }
+            munmap(p, sizeof(sbitx_shm));
+        }
+        lock.lock();
+#endif
+        cv_.wait_for(lock, std::chrono::milliseconds(kResubscribeMs), [&] { return stop_; });
+    }
+}
+
+// TCP: keep a subscription open and cache what the daemon pushes.
+void CtrlClient::watchSubscription()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_)
+    {
+        lock.unlock();
+
+        int fd = openLink();
+        std::string buf, line;
+        lock.lock();
+        if (stop_)
+        {
+            closeFd(fd);
+            return;
+        }
+        watchFd_ = fd; // closed only under mutex_, so ~CtrlClient never shuts down a reused fd
+        lock.unlock();
+
+        if (fd >= 0 && sendAll(fd, "S\n"))
+        {
+            // Heartbeats arrive every second, so a read that waits kStaleMs
+            // without one means the daemon (or the link) is gone.
+            while (readLine(fd, buf, line, kStaleMs))
+            {
+                unsigned long long hz = 0;
+                int tx = 0;
+                if (line.rfind("ERR", 0) == 0)
+                {
+                    SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX ctrl: %s:%d has no subscribe command, "
+                                   "getFrequency falls back to the last value set", host_.c_str(), port_);
+                    std::lock_guard<std::mutex> g(mutex_);
+                    watchFd_ = -1;
+                    closeFd(fd);
+                    return;
+                }
+                if (std::sscanf(line.c_str(), "! %llu %d", &hz, &tx) != 2) continue;
+
+                pushed_.store(((uint64_t)hz << 1) | (tx ? 1u : 0u), std::memory_order_relaxed);
+                pushedNs_.store(monotonicNs(), std::memory_order_release);
+                dropWant((long long)hz);
+
+                std::lock_guard<std::mutex> g(mutex_);
+                if (stop_) break;
+            }
+        }
+        pushedNs_.store(0, std::memory_order_release);
+
+        lock.lock();
+        watchFd_ = -1;
+        closeFd(fd);
+        cv_.wait_for(lock, std::chrono::milliseconds(kResubscribeMs), [&] { return stop_; });
+    }
+}
+
+int CtrlClient::openLink() const
+{
+#ifndef __linux__
+    return -1;
+#else
+    if (!unixPath_.empty())
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (unixPath_.size() >= sizeof(addr.sun_path)) return -1;
+        std::memcpy(addr.sun_path, unixPath_.c_str(), unixPath_.size() + 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *res = nullptr;
+    const std::string port = std::to_string(port_);
+    if (getaddrinfo(host_.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next)
+    {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+
+    // Commands are tiny and latency is the whole point.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+#endif
+}
+
+void CtrlClient::closeFd(int fd)
+{
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#else
+    (void)fd;
+#endif
+}
+
+void CtrlClient::closeLink()
+{
+    closeFd(fd_);
+    fd_ = -1;
+    rxBuf_.clear();
+}
+
+bool CtrlClient::sendAll(int fd, const std::string &data)
+{
+#ifndef __linux__
+    (void)fd; (void)data;
+    return false;
+#else
+    size_t off = 0;
+    while (off < data.size())
+    {
+        const ssize_t w = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        off += (size_t)w;
+    }
+    return true;
+#endif
+}
+
+// Append whatever arrives within timeoutMs; false on timeout, EOF or error.
+bool CtrlClient::fill(int fd, std::string &buf, int timeoutMs)
+{
+#ifndef __linux__
+    (void)fd; (void)buf; (void)timeoutMs;
+    return false;
+#else
+    while (true)
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        const int pr = poll(&pfd, 1, timeoutMs);
+        if (pr < 0 && errno == EINTR) continue;
+        if (pr <= 0) return false;
+
+        char chunk[256];
+        const ssize_t r = ::read(fd, chunk, sizeof(chunk));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf.append(chunk, (size_t)r);
+        return true;
+    }
+#endif
+}
+
+bool CtrlClient::readLine(int fd, std::string &buf, std::string &line, int timeoutMs)
+{
+    size_t nl;
+    while ((nl = buf.find('\n')) == std::string::npos)
+        if (!fill(fd, buf, timeoutMs)) return false;
+
+    line = buf.substr(0, nl);
+    buf.erase(0, nl + 1);
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+        line.pop_back();
+    return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "RealTime.hpp"
+#include "Stats.hpp"
+
+struct sbitx_shm;
+
+// Persistent connection to sbitx_ctrl, driven by its own command thread.
+//
+// Callers never touch the socket: commands are queued and the thread
+// writes everything pending in one go, then reads the replies back in
+// order (sbitx_ctrl answers every command). A run of frequency changes
+// that has not gone out yet collapses to the latest one, so dragging the
+// VFO costs one command per round trip rather than one connection per
+// step. The connection is opened lazily and re-opened after any error.
+//
+// Over TCP the protocol is text, and a second connection subscribes ("S")
+// so the daemon pushes frequency and PTT on every change plus a heartbeat
+// each second; the watch thread keeps the latest values in atomics.
+//
+// Over the AF_UNIX socket commands use the binary frames from
+// sbitx_ctrl.h, and state comes straight from the daemon's shared-memory
+// block (a seqlock), so state() makes no syscall at all.
+//
+// Either way, if nothing has been heard for kStaleMs the daemon is
+// presumed gone and state() fails.
+class CtrlClient
+{
+public:
+    // Both threads start under `tp` (cpu= pinning; never FIFO).
+    CtrlClient(const std::string &host, int port, const ThreadProfile &tp = ThreadProfile());
+    explicit CtrlClient(const std::string &unixPath, const ThreadProfile &tp = ThreadProfile());
+    ~CtrlClient();
+
+    // Fire and forget; both return immediately.
+    void setFrequency(long long hz);
+    void setPTT(bool on);
+
+    // 'f' or 't', queued behind any pending commands; false on timeout or
+    // link error.
+    bool query(char op, long long &value, long timeoutUs);
+
+    // Latest published state, never blocks. A frequency set through this
+    // client reads back immediately, before the daemon has echoed it.
+    // False when the daemon is gone or has never been heard from.
+    bool state(long long &hz, bool &ptt) const;
+
+    static constexpr int kStaleMs = 3000;
+
+    // Frequency commands the daemon has acknowledged, i.e. LO writes that
+    // have completed. Any thread.
+    unsigned long long freqApplied() const { return freqApplied_.load(std::memory_order_acquire); }
+
+    // Recorded by the command thread: send -> reply for every command, and
+    // setPTT() -> daemon acknowledged for PTT changes.
+    const LatencyStats &rtt() const { return rtt_; }
+    const LatencyStats &pttLatency() const { return pttLatency_; }
+
+private:
+    struct Reply
+    {
+        bool ok;
+        long long value;
+    };
+
+    struct Request
+    {
+        char op = 0;          // 'f', 'F', 't', 'T'
+        long long value = -1; // argument of F / T
+        long long queuedNs = 0;
+        std::shared_ptr<std::promise<Reply>> reply; // null: no one waiting
+    };
+
+    void start();
+    void enqueue(Request r);
+    void threadMain();
+    void watchMain();
+    void watchShm();
+    void watchSubscription();
+    void dropWant(long long hz) const;
+
+    std::string encode(const Request &r) const;
+    bool readReply(Reply &rep, std::string &text);
+
+    int openLink() const;
+    void closeLink();
+    static void closeFd(int fd);
+    static bool sendAll(int fd, const std::string &data);
+    static bool fill(int fd, std::string &buf, int timeoutMs);
+    static bool readLine(int fd, std::string &buf, std::string &line, int timeoutMs);
+
+    std::string host_;
+    int port_ = 0;
+    std::string unixPath_; // non-empty: AF_UNIX, binary frames, shm state
+    ThreadProfile tp_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> queue_;
+    bool stop_ = false;
+    std::thread thread_;
+    std::thread watchThread_;
+    int watchFd_ = -1; // TCP subscription, under mutex_
+
+    // Command thread only
+    int fd_ = -1;
+    std::string rxBuf_;
+    unsigned failures_ = 0;
+    LatencyStats rtt_;
+    LatencyStats pttLatency_;
+    std::atomic<unsigned long long> freqApplied_{0};
+
+    // TCP: pushed state, hz << 1 | ptt, and when it last arrived (0: lost)
+    std::atomic<uint64_t> pushed_{0};
+    std::atomic<long long> pushedNs_{0};
+
+    // AF_UNIX: the daemon's state block, mapped read-only once it exists
+    std::atomic<const sbitx_shm *> shm_{nullptr};
+
+    mutable std::atomic<long long> wantHz_{-1}; // set here, not echoed back yet
+};
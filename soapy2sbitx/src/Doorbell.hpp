@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Sleep/wake between the two sides of a lock-free ring.
+//
+// The side that makes progress calls ring() after publishing; it only takes
+// the mutex when somebody is actually asleep, so an RT thread that rings
+// every period normally pays one fence and one relaxed load.
+class Doorbell
+{
+public:
+    void ring()
+    {
+        // Pairs with the fetch_add in waitFor: either the waiter sees the
+        // new state, or we see the waiter and notify it.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+    }
+
+    // Sleeps until ready() holds or timeoutUs passes; returns ready().
+    // Each wake-up that was not a timeout is added to *wakeups.
+    template <typename Ready>
+    bool waitFor(Ready ready, long timeoutUs, unsigned long long *wakeups = nullptr)
+    {
+        if (ready()) return true;
+
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::microseconds(std::max(0L, timeoutUs));
+
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool ok = true;
+        while (!ready())
+        {
+            if (cv_.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                ok = ready();
+                break;
+            }
+            if (wakeups) (*wakeups)++;
+        }
+        lock.unlock();
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<int> waiters_{0};
+};
@@ -0,0 +1,219 @@
+#include "DspChain.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+static inline int32_t float_to_s32(float x)
+{
+    x = std::max(-1.0f, std::min(0.999999f, x));
+    const float scale = 2147483647.0f;
+    return (int32_t)std::lrintf(x * scale);
+}
+
+static inline int16_t float_to_s16(float x)
+{
+    x = std::max(-1.0f, std::min(0.99997f, x));
+    return (int16_t)std::lrintf(x * 32767.0f);
+}
+
+// In-place I/Q fix-ups on interleaved pairs (float, int32 or int16).
+template <typename T>
+static void applyIqFix(T *iq, size_t n, bool inv, bool swap)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        T I = iq[2 * i + 0];
+        T Q = iq[2 * i + 1];
+
+        if (inv)
+            Q = (std::numeric_limits<T>::is_integer && Q == std::numeric_limits<T>::min())
+                    ? std::numeric_limits<T>::max() : (T)-Q;
+        if (swap) std::swap(I, Q);
+
+        iq[2 * i + 0] = I;
+        iq[2 * i + 1] = Q;
+    }
+}
+
+// ------------------- RX -------------------
+
+// Two channels: [ch0 I, ch0 Q, ch1 I, ch1 Q] per sample, ch1 zero if null.
+template <typename T>
+static void interleave(const T *ch0, const T *ch1, size_t n, T *dst)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[4 * i + 0] = ch0[2 * i + 0];
+        dst[4 * i + 1] = ch0[2 * i + 1];
+        dst[4 * i + 2] = ch1 ? ch1[2 * i + 0] : T(0);
+        dst[4 * i + 3] = ch1 ? ch1[2 * i + 1] : T(0);
+    }
+}
+
+// Interleaved float pairs -> integer pairs, saturating.
+static void toS32(const std::complex<float> *iq, size_t n, int32_t *dst)
+{
+    const float *f = reinterpret_cast<const float*>(iq);
+    for (size_t i = 0; i < 2 * n; i++) dst[i] = float_to_s32(f[i]);
+}
+
+static void toS16(const std::complex<float> *iq, size_t n, int16_t *dst)
+{
+    const float *f = reinterpret_cast<const float*>(iq);
+    for (size_t i = 0; i < 2 * n; i++) dst[i] = float_to_s16(f[i]);
+}
+
+RxChain::RxChain(unsigned capFs, unsigned fs, double ifHz, unsigned decTaps)
+    : capFs_(capFs), ifHz_(ifHz), fs_(fs), decim_(decTaps), micDecim_(decTaps)
+{
+    nco_.setFrequency(ifHz, capFs);
+}
+
+void RxChain::retune()
+{
+    // Inverting or swapping I/Q mirrors the spectrum, so the offset in the
+    // IF runs the other way.
+    const double hz = (iqInv_ != iqSwap_) ? -shiftHz_ : shiftHz_;
+    nco_.setFrequency(ifHz_ + hz, capFs_);
+}
+
+void RxChain::configure(RxFormat fmt, unsigned outFs, size_t maxFrames, unsigned channels)
+{
+    const size_t half = (maxFrames + 1) / 2;
+    fmt_ = fmt;
+    channels_ = channels;
+    rate_.reset(new RateChain(fs_, outFs));
+    outIQ_.resize(half);
+    rateIQ_.resize(rate_->maxOutput(half));
+    const size_t most = 2 * std::max(half, rateIQ_.size());
+    if (fmt == RX_CS32) outQ31_.resize(most);
+    if (fmt == RX_CS16) outS16_.resize(most);
+
+    if (channels_ == 2)
+    {
+        micRate_.reset(new RateChain(fs_, outFs));
+        micIQ_.resize(outIQ_.size());
+        micRateIQ_.resize(rateIQ_.size());
+        micQ31_.resize(outQ31_.size());
+        micS16_.resize(outS16_.size());
+        const size_t pairs = 4 * std::max(half, rateIQ_.size());
+        if (fmt == RX_CF32) pairF32_.resize(pairs);
+        if (fmt == RX_CS32) pairQ31_.resize(pairs);
+        if (fmt == RX_CS16) pairS16_.resize(pairs);
+    }
+    micStale_ = true;
+}
+
+// Fresh mic filters, emitting on the same inputs as channel 0's.
+void RxChain::syncMic()
+{
+    micDecim_.reset();
+    micDecim_.syncPhase(decim_);
+    micRate_->reset();
+    micRate_->syncPhase(*rate_);
+    micStale_ = false;
+}
+
+size_t RxChain::process(const int32_t *in, size_t stride, size_t frames, const void *&out)
+{
+    // A mono capture has no mic; channel 1 stays silent.
+    const bool mic = channels_ == 2 && mic_ && stride >= 2;
+    if (mic && micStale_) syncMic();
+    if (!mic) micStale_ = true;
+
+    // Mix + halfband filter + decimate in one pass over the frames
+    size_t o = mic ? decim_.mixDecimate2(in, stride, frames, nco_, outIQ_.data(), micDecim_, micIQ_.data())
+                   : decim_.mixDecimate(in, stride, frames, nco_, outIQ_.data());
+
+    // I/Q fixes commute with the (real) rate filters; do them at 48k so
+    // wide() sees them too.
+    if (iqInv_ || iqSwap_) applyIqFix(reinterpret_cast<float*>(outIQ_.data()), o, iqInv_, iqSwap_);
+    wideN_ = o;
+
+    const std::complex<float> *f = outIQ_.data();
+    const std::complex<float> *m = micIQ_.data();
+    if (!rate_->passthrough())
+    {
+        if (mic) micRate_->process(micIQ_.data(), o, micRateIQ_.data());
+        m = micRateIQ_.data();
+        o = rate_->process(outIQ_.data(), o, rateIQ_.data());
+        f = rateIQ_.data();
+    }
+
+    if (fmt_ == RX_CF32)
+    {
+        out = f;
+        if (channels_ == 2)
+        {
+            interleave(reinterpret_cast<const float*>(f), mic ? reinterpret_cast<const float*>(m) : nullptr,
+                       o, pairF32_.data());
+            out = pairF32_.data();
+        }
+    }
+    else if (fmt_ == RX_CS32)
+    {
+        toS32(f, o, outQ31_.data());
+        out = outQ31_.data();
+        if (channels_ == 2)
+        {
+            if (mic) toS32(m, o, micQ31_.data());
+            interleave(outQ31_.data(), mic ? micQ31_.data() : nullptr, o, pairQ31_.data());
+            out = pairQ31_.data();
+        }
+    }
+    else
+    {
+        toS16(f, o, outS16_.data());
+        out = outS16_.data();
+        if (channels_ == 2)
+        {
+            if (mic) toS16(m, o, micS16_.data());
+            interleave(outS16_.data(), mic ? micS16_.data() : nullptr, o, pairS16_.data());
+            out = pairS16_.data();
+        }
+    }
+    return o;
+}
+
+const std::complex<float> *RxChain::wide(size_t &n)
+{
+    n = wideN_;
+    return outIQ_.data();
+}
+
+// ------------------- TX -------------------
+
+TxChain::TxChain(unsigned pbFs, double ifHz)
+    : pbFs_(pbFs), ifHz_(ifHz)
+{
+    nco_.setFrequency(ifHz, pbFs);
+}
+
+void TxChain::setShift(double hz, bool swap)
+{
+    if (swap) hz = -hz;
+    if (hz == shiftHz_) return;
+    shiftHz_ = hz;
+    nco_.setFrequency(ifHz_ + hz, pbFs_);
+}
+
+void TxChain::upconvert(const std::complex<float> *in, size_t firstFrame, size_t frames,
+                        int32_t *dst, size_t stride, float gain, bool swap)
+{
+    for (size_t j = 0; j < frames; j++)
+    {
+        float I = in[(firstFrame + j) / 2].real();
+        float Q = in[(firstFrame + j) / 2].imag();
+
+        if (swap)
+            std::swap(I, Q);
+
+        const std::complex<float> lo = nco_.next();
+        const float y = (I * lo.real() - Q * lo.imag()) * gain;
+
+        dst[j * stride + 0] = 0;               // L unused
+        dst[j * stride + 1] = float_to_s32(y); // R = TX IF
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "HalfbandDecimator.hpp"
+#include "NCO.hpp"
+#include "Resampler.hpp"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The driver's signal path, kept free of ALSA and SoapySDR so the RX/TX
+// threads and bench/dsp_bench.cpp run exactly the same code.
+
+// RX sample formats; the ring carries samples in this format
+enum RxFormat
+{
+    RX_CF32, // float, full scale 1.0
+    RX_CS32, // Q31, the codec's own full scale
+    RX_CS16, // Q15, half the ring bandwidth
+};
+
+// 96k S32 stereo capture, real IF on the left channel -> complex IQ at the
+// stream rate:
+//  1) Mix down by e^{-j*ph} at IF (NCO)
+//  2) halfband FIR lowpass and decimate-by-2 (dec_taps=)
+//  3) convert 48k to the stream rate (RateChain, skipped at 48k)
+//
+// Every format runs this in float; CS32/CS16 are a saturating conversion
+// of the result, which costs less than an integer mixer and FIR would.
+//
+// With two channels the mic (right channel) rides along as channel 1: read
+// in the same pass over the frames, not mixed (Q = 0), decimated and rate
+// converted by twins of the same filters, and interleaved after each
+// channel 0 sample. While the mic is off channel 1 is zeros and costs
+// nothing but the interleave.
+//
+// Filter and oscillator state carry across calls and across configure().
+class RxChain
+{
+public:
+    RxChain() = default;
+    RxChain(unsigned capFs, unsigned fs, double ifHz, unsigned decTaps);
+
+    unsigned decTaps() const { return decim_.taps(); }
+
+    // Allocates; call before process() and whenever the format, output
+    // rate, channel count or largest period changes.
+    void configure(RxFormat fmt, unsigned outFs, size_t maxFrames, unsigned channels = 1);
+    bool configured(RxFormat fmt, unsigned outFs, unsigned channels = 1) const
+    {
+        return rate_ && fmt_ == fmt && rate_->outFs() == outFs && channels_ == channels;
+    }
+
+    // Channel 1 DSP on or off (two channels only). Switching it on lines
+    // the mic filters up with channel 0's; never allocates.
+    void setMic(bool on) { mic_ = on; }
+
+    void setIqFix(bool inv, bool swap)
+    {
+        iqInv_ = inv;
+        iqSwap_ = swap;
+        retune();
+    }
+
+    // Fine tuning: what lies `hz` above the centre comes out at DC. Moves
+    // the IF NCO, phase continuous; never allocates.
+    void setShift(double hz)
+    {
+        if (hz == shiftHz_) return;
+        shiftHz_ = hz;
+        retune();
+    }
+
+    // One capture period (channel 0 of `frames` frames, `stride` ints
+    // apart; channel 1 next to it) -> stream samples at `out`, owned here
+    // and valid until the next call. Returns how many (per channel). Never
+    // allocates.
+    size_t process(const int32_t *in, size_t stride, size_t frames, const void *&out);
+
+    // Channel 0 of the last process() call at the decimator rate (fs), as
+    // float, before any rate conversion: the channelizer's input. Valid
+    // until the next process().
+    const std::complex<float> *wide(size_t &n);
+
+private:
+    void syncMic();
+    void retune();
+
+    unsigned capFs_ = 96000;
+    double ifHz_ = 24000.0;
+    double shiftHz_ = 0.0;
+    unsigned fs_ = 48000;
+    RxFormat fmt_ = RX_CF32;
+    unsigned channels_ = 1;
+    bool iqInv_ = false;
+    bool iqSwap_ = false;
+    bool mic_ = false;
+    bool micStale_ = true; // mic filters not in step with channel 0
+    size_t wideN_ = 0; // outIQ_ holds wideN_ samples of channel 0
+
+    NCO nco_;
+    HalfbandDecimator decim_;
+    std::unique_ptr<RateChain> rate_;
+
+    std::vector<std::complex<float>> outIQ_;
+    std::vector<std::complex<float>> rateIQ_;
+    std::vector<int32_t> outQ31_;
+    std::vector<int16_t> outS16_;
+
+    // Channel 1 (two channels only)
+    HalfbandDecimator micDecim_;
+    std::unique_ptr<RateChain> micRate_;
+    std::vector<std::complex<float>> micIQ_;
+    std::vector<std::complex<float>> micRateIQ_;
+    std::vector<int32_t> micQ31_;
+    std::vector<int16_t> micS16_;
+    std::vector<float> pairF32_;   // interleaved output, per format
+    std::vector<int32_t> pairQ31_;
+    std::vector<int16_t> pairS16_;
+};
+
+// 48k IQ -> 96k real IF on the right channel of S32 stereo frames, left
+// silent.
+class TxChain
+{
+public:
+    TxChain() = default;
+    TxChain(unsigned pbFs, double ifHz);
+
+    // Output frame f (counted from in[0]) carries in[f/2], so a run can
+    // start mid-sample. gain is linear, swap exchanges I and Q.
+    void upconvert(const std::complex<float> *in, size_t firstFrame, size_t frames,
+                   int32_t *dst, size_t stride, float gain, bool swap);
+
+    // Baseband DC goes out `hz` above the centre (swap: as upconvert's).
+    // Phase continuous.
+    void setShift(double hz, bool swap);
+
+private:
+    unsigned pbFs_ = 96000;
+    double ifHz_ = 24000.0;
+    double shiftHz_ = 0.0;
+    NCO nco_;
+};
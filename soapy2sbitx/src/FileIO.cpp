@@ -0,0 +1,392 @@
+#include "FileIO.hpp"
+
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static long long monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "a;b=1;c" -> {"a", "b=1", "c"}. ',' works too when the spec does not go
+// through a Soapy args string (which splits on commas itself).
+static std::vector<std::string> splitOpts(const std::string &s)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (size_t i = 0; i <= s.size(); i++)
+    {
+        if (i < s.size() && s[i] != ';' && s[i] != ',') continue;
+        if (i > start) out.push_back(s.substr(start, i - start));
+        start = i + 1;
+    }
+    return out;
+}
+
+static uint32_t le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint16_t le16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+static void putLe32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void Pacer::sleepUntil(long long ns) const
+{
+    if (fast_) return;
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns)));
+}
+
+// ------------------- capture -------------------
+
+PacedCapture::PacedCapture(const AudioConfig &cfg, bool fast)
+    : pacer_(cfg.rate, fast), rate_(cfg.rate), period_(cfg.periodFrames),
+      bufferNs_(pacer_.framesNs(cfg.bufferFrames)), buf_(cfg.periodFrames * 2, 0)
+{
+}
+
+bool PacedCapture::begin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count)
+{
+    const size_t n = std::min(maxFrames, period_);
+    if (!fill(buf_.data(), n)) return false;
+
+    // The period [frames_, frames_ + n) is complete at dueNs(frames_ + n).
+    const long long now = monotonicNs();
+    if (frames_ == 0) pacer_.rebase(now - pacer_.framesNs(n), 0);
+    if (!pacer_.fast())
+    {
+        const long long due = pacer_.dueNs(frames_ + n);
+        if (now - due > bufferNs_)
+        {
+            // Away longer than the buffer holds: the codec would have overrun.
+            xruns_++;
+            pacer_.rebase(now - pacer_.framesNs(n), frames_);
+        }
+        else
+            pacer_.sleepUntil(due);
+    }
+
+    firstNs_ = pacer_.dueNs(frames_);
+    frames_ += n;
+    frames = buf_.data();
+    stride = 2;
+    count = n;
+    return true;
+}
+
+std::unique_ptr<FileCapture> FileCapture::open(const std::string &opts, AudioConfig &cfg)
+{
+    const std::vector<std::string> o = splitOpts(opts);
+    if (o.empty())
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: file: needs a path");
+        return nullptr;
+    }
+
+    bool fast = false, loop = false;
+    for (size_t i = 1; i < o.size(); i++)
+    {
+        if (o[i] == "fast") fast = true;
+        else if (o[i] == "loop") loop = true;
+        else SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: file: ignoring option '%s'", o[i].c_str());
+    }
+
+    std::unique_ptr<FileCapture> c(new FileCapture(cfg, fast));
+    c->path_ = o[0];
+    c->loop_ = loop;
+    c->f_ = std::fopen(c->path_.c_str(), "rb");
+    if (!c->f_)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: cannot open %s: %s", c->path_.c_str(), std::strerror(errno));
+        return nullptr;
+    }
+    std::setvbuf(c->f_, nullptr, _IOFBF, 1 << 20);
+
+    uint8_t hdr[12];
+    if (std::fread(hdr, 1, sizeof(hdr), c->f_) == sizeof(hdr) &&
+        !std::memcmp(hdr, "RIFF", 4) && !std::memcmp(hdr + 8, "WAVE", 4))
+    {
+        if (!c->parseWav()) return nullptr;
+    }
+    else
+        std::fseek(c->f_, 0, SEEK_SET); // raw S32_LE stereo
+
+    c->raw_.resize(c->period_ * c->channels_ * c->bytesPerSample_);
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: replaying %s (%u ch, %u-bit)%s%s", c->path_.c_str(),
+                   c->channels_, c->bytesPerSample_ * 8, fast ? ", fast" : "", loop ? ", loop" : "");
+    return c;
+}
+
+FileCapture::~FileCapture()
+{
+    if (f_) std::fclose(f_);
+}
+
+bool FileCapture::parseWav()
+{
+    bool haveFmt = false;
+    uint8_t ck[8];
+    while (std::fread(ck, 1, sizeof(ck), f_) == sizeof(ck))
+    {
+        const uint32_t size = le32(ck + 4);
+        const long next = std::ftell(f_) + (long)size + (long)(size & 1);
+
+        if (!std::memcmp(ck, "fmt ", 4) && size >= 16)
+        {
+            uint8_t fmt[40] = {};
+            if (std::fread(fmt, 1, std::min<size_t>(size, sizeof(fmt)), f_) < 16) break;
+            uint16_t tag = le16(fmt);
+            if (tag == 0xFFFE && size >= 26) tag = le16(fmt + 24); // extensible: subformat GUID
+            const unsigned rate = le32(fmt + 4);
+            channels_ = le16(fmt + 2);
+            bytesPerSample_ = le16(fmt + 14) / 8;
+
+            if (tag != 1 || channels_ < 1 || channels_ > 2 || bytesPerSample_ < 2 || bytesPerSample_ > 4)
+            {
+                SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: %s: need 16/24/32-bit PCM, mono or stereo",
+                               path_.c_str());
+                return false;
+            }
+            if (rate != 0 && rate != rate_)
+                SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: %s is %u Hz, playing it at the codec rate",
+                               path_.c_str(), rate);
+            haveFmt = true;
+        }
+        else if (!std::memcmp(ck, "data", 4) && haveFmt)
+        {
+            dataOffset_ = std::ftell(f_);
+            dataFrames_ = size / (channels_ * bytesPerSample_);
+            return true;
+        }
+        std::fseek(f_, next, SEEK_SET);
+    }
+
+    SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: %s: no fmt/data chunk", path_.c_str());
+    return false;
+}
+
+size_t FileCapture::readFrames(int32_t *dst, size_t n)
+{
+    n = (size_t)std::min<uint64_t>(n, dataFrames_ - pos_);
+    if (!n) return 0;
+
+    const size_t frameBytes = channels_ * bytesPerSample_;
+    if (channels_ == 2 && bytesPerSample_ == 4)
+    {
+        const size_t got = std::fread(dst, frameBytes, n, f_);
+        pos_ += got;
+        return got;
+    }
+
+    const size_t got = std::fread(raw_.data(), frameBytes, n, f_);
+    for (size_t i = 0; i < got * channels_; i++)
+    {
+        const uint8_t *p = raw_.data() + i * bytesPerSample_;
+        int32_t s;
+        if (bytesPerSample_ == 2) s = (int32_t)((uint32_t)le16(p) << 16);
+        else if (bytesPerSample_ == 3) s = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+        else s = (int32_t)le32(p);
+
+        if (channels_ == 1)
+        {
+            dst[2 * i] = s;
+            dst[2 * i + 1] = 0;
+        }
+        else
+            dst[i] = s;
+    }
+    pos_ += got;
+    return got;
+}
+
+bool FileCapture::fill(int32_t *dst, size_t n)
+{
+    size_t got = readFrames(dst, n);
+    while (got < n && loop_)
+    {
+        std::fseek(f_, dataOffset_, SEEK_SET);
+        pos_ = 0;
+        const size_t more = readFrames(dst + got * 2, n - got);
+        if (!more) break; // empty file
+        got += more;
+    }
+
+    if (got == 0)
+    {
+        if (!eofLogged_) SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: end of %s", path_.c_str());
+        eofLogged_ = true;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(pacer_.framesNs(period_)));
+        return false;
+    }
+    std::fill(dst + got * 2, dst + n * 2, 0);
+    return true;
+}
+
+std::unique_ptr<SynthCapture> SynthCapture::open(const std::string &opts, AudioConfig &cfg)
+{
+    double tone = 1000.0, level = -20.0, noise = -1000.0;
+    bool fast = false;
+    for (const std::string &o : splitOpts(opts))
+    {
+        const size_t eq = o.find('=');
+        const std::string k = o.substr(0, eq);
+        const double v = eq == std::string::npos ? 0.0 : std::atof(o.c_str() + eq + 1);
+        if (k == "tone") tone = v;
+        else if (k == "level") level = v;
+        else if (k == "noise") noise = v;
+        else if (k == "fast") fast = true;
+        else SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: synth: ignoring option '%s'", o.c_str());
+    }
+
+    std::unique_ptr<SynthCapture> c(new SynthCapture(cfg, fast));
+    c->nco_.setFrequency(cfg.ifHz + tone, cfg.rate);
+    c->level_ = (float)std::pow(10.0, level / 20.0);
+    c->noise_ = (float)std::pow(10.0, noise / 20.0);
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: synth tone %+.0f Hz at %.1f dBFS, noise %.1f dBFS%s",
+                   tone, level, noise, fast ? ", fast" : "");
+    return c;
+}
+
+// Sum of four uniforms, scaled to unit variance: close enough to Gaussian
+// for a noise floor, and much cheaper than Box-Muller.
+float SynthCapture::gauss()
+{
+    float sum = 0.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        sum += (float)(rng_ >> 8) * (1.0f / 16777216.0f);
+    }
+    return (sum - 2.0f) * 1.7320508f;
+}
+
+bool SynthCapture::fill(int32_t *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        float x = level_ * nco_.next().real();
+        if (noise_ > 0.0f) x += noise_ * gauss();
+        x = std::max(-1.0f, std::min(0.999999f, x));
+        dst[2 * i] = (int32_t)std::lrintf(x * 2147483647.0f);
+        dst[2 * i + 1] = 0; // mic
+    }
+    return true;
+}
+
+// ------------------- playback -------------------
+
+// 44-byte PCM header for S32_LE stereo; sizes are patched on close.
+static void writeWavHeader(std::FILE *f, unsigned rate, uint64_t dataBytes)
+{
+    const uint32_t data = (uint32_t)std::min<uint64_t>(dataBytes, 0xFFFFFFFFu - 36);
+    uint8_t h[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                     'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,
+                     0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 32, 0,
+                     'd', 'a', 't', 'a', 0, 0, 0, 0};
+    putLe32(h + 4, 36 + data);
+    putLe32(h + 24, rate);
+    putLe32(h + 28, rate * 8);
+    putLe32(h + 40, data);
+    std::fseek(f, 0, SEEK_SET);
+    std::fwrite(h, 1, sizeof(h), f);
+}
+
+FileSink::FileSink(const AudioConfig &cfg, bool fast)
+    : rate_(cfg.rate), pacer_(cfg.rate, fast), period_(cfg.periodFrames),
+      bufferNs_(pacer_.framesNs(cfg.bufferFrames)), buf_(cfg.periodFrames * 2, 0)
+{
+}
+
+std::unique_ptr<FileSink> FileSink::open(const std::string &opts, bool toFile, AudioConfig &cfg)
+{
+    const std::vector<std::string> o = splitOpts(opts);
+    if (toFile && o.empty())
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: file: needs a path");
+        return nullptr;
+    }
+
+    bool fast = false;
+    for (size_t i = toFile ? 1 : 0; i < o.size(); i++)
+    {
+        if (o[i] == "fast") fast = true;
+        else SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: tx sink: ignoring option '%s'", o[i].c_str());
+    }
+
+    std::unique_ptr<FileSink> s(new FileSink(cfg, fast));
+    if (!toFile) return s;
+
+    const std::string &path = o[0];
+    s->f_ = std::fopen(path.c_str(), "wb");
+    if (!s->f_)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: cannot create %s: %s", path.c_str(), std::strerror(errno));
+        return nullptr;
+    }
+    std::setvbuf(s->f_, nullptr, _IOFBF, 1 << 20);
+    s->wav_ = path.size() > 4 && path.compare(path.size() - 4, 4, ".wav") == 0;
+    if (s->wav_) writeWavHeader(s->f_, s->rate_, 0);
+    return s;
+}
+
+FileSink::~FileSink()
+{
+    if (!f_) return;
+    if (wav_) writeWavHeader(f_, rate_, frames_ * 8);
+    std::fclose(f_);
+}
+
+bool FileSink::write(size_t frames, FrameRenderer &r)
+{
+    for (size_t done = 0; done < frames;)
+    {
+        const size_t n = std::min(frames - done, period_);
+        r.render(done, n, buf_.data(), 2);
+        if (f_ && std::fwrite(buf_.data(), 8, n, f_) != n)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX: TX file write failed: %s", std::strerror(errno));
+            return false;
+        }
+        pace(n);
+        done += n;
+    }
+    return true;
+}
+
+void FileSink::pace(size_t n)
+{
+    if (pacer_.fast())
+    {
+        frames_ += n;
+        return;
+    }
+
+    // The emulated device plays frame k at dueNs(k); if that has passed
+    // for the next frame it ran dry, and restarts from now.
+    const long long now = monotonicNs();
+    if (frames_ == 0 || pacer_.dueNs(frames_) < now)
+    {
+        if (frames_) xruns_++;
+        pacer_.rebase(now, frames_);
+    }
+    frames_ += n;
+
+    // Block while more than a buffer's worth is queued.
+    pacer_.sleepUntil(pacer_.dueNs(frames_) - bufferNs_);
+}
+
+long long FileSink::queuedNs()
+{
+    if (pacer_.fast() || frames_ == 0) return 0;
+    return std::max(0LL, pacer_.dueNs(frames_) - monotonicNs());
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "AudioIO.hpp"
+#include "NCO.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Backends that stand in for the codec: a recording or a generated signal
+// on capture, a file (or nothing) on playback.
+//
+// By default they run in real time: a Pacer holds them to the sample rate
+// from the monotonic clock, capture timestamps follow it, and a stall
+// longer than the emulated buffer counts as an xrun just as the codec
+// would report one. With `fast` they run flat out (offline processing,
+// throughput tests) and timestamps are nominal.
+
+// Frame `k` is due at start + k / rate.
+class Pacer
+{
+public:
+    Pacer(unsigned rate, bool fast) : rate_(rate), fast_(fast) {}
+
+    long long dueNs(uint64_t frame) const
+    {
+        return startNs_ + (long long)((double)(frame - startFrame_) * 1e9 / rate_);
+    }
+    long long framesNs(size_t frames) const { return (long long)((double)frames * 1e9 / rate_); }
+
+    void rebase(long long ns, uint64_t frame)
+    {
+        startNs_ = ns;
+        startFrame_ = frame;
+    }
+
+    void sleepUntil(long long ns) const;
+    bool fast() const { return fast_; }
+
+private:
+    unsigned rate_;
+    bool fast_;
+    long long startNs_ = 0;
+    uint64_t startFrame_ = 0;
+};
+
+// Hands out one period per begin(), as a codec would.
+class PacedCapture : public CaptureSource
+{
+public:
+    bool begin(size_t maxFrames, const int32_t *&frames, size_t &stride, size_t &count) override;
+    long long firstFrameNs() override { return firstNs_; }
+
+protected:
+    PacedCapture(const AudioConfig &cfg, bool fast);
+
+    // Fills `n` S32 stereo frames; false when there is nothing to give.
+    virtual bool fill(int32_t *dst, size_t n) = 0;
+
+    Pacer pacer_;
+    unsigned rate_;
+    size_t period_;
+    long long bufferNs_;
+
+private:
+    std::vector<int32_t> buf_;
+    uint64_t frames_ = 0; // handed out so far
+    long long firstNs_ = 0;
+};
+
+// "file:<path>[;fast][;loop]": a .wav (PCM 16/24/32-bit, mono or stereo;
+// mono goes to the IF channel) or raw S32_LE stereo, e.g. a capture made
+// with `arecord -f S32_LE -c 2 -r 96000 -t raw`.
+class FileCapture : public PacedCapture
+{
+public:
+    ~FileCapture() override;
+    static std::unique_ptr<FileCapture> open(const std::string &opts, AudioConfig &cfg);
+
+protected:
+    bool fill(int32_t *dst, size_t n) override;
+
+private:
+    FileCapture(const AudioConfig &cfg, bool fast) : PacedCapture(cfg, fast) {}
+    bool parseWav();
+    size_t readFrames(int32_t *dst, size_t n);
+
+    std::FILE *f_ = nullptr;
+    std::string path_;
+    bool loop_ = false;
+    bool eofLogged_ = false;
+    unsigned channels_ = 2;
+    unsigned bytesPerSample_ = 4;
+    long dataOffset_ = 0;
+    uint64_t dataFrames_ = UINT64_MAX; // raw: until EOF
+    uint64_t pos_ = 0;
+    std::vector<uint8_t> raw_;
+};
+
+// "synth:[tone=Hz][;level=dBFS][;noise=dBFS][;fast]": a carrier `tone` Hz
+// above the IF (so it decodes at +tone in baseband) plus white noise.
+class SynthCapture : public PacedCapture
+{
+public:
+    static std::unique_ptr<SynthCapture> open(const std::string &opts, AudioConfig &cfg);
+
+protected:
+    bool fill(int32_t *dst, size_t n) override;
+
+private:
+    SynthCapture(const AudioConfig &cfg, bool fast) : PacedCapture(cfg, fast) {}
+    float gauss();
+
+    NCO nco_;
+    float level_ = 0.1f;
+    float noise_ = 0.0f;
+    uint32_t rng_ = 0x9e3779b9u;
+};
+
+// "file:<path>[;fast]" (a .wav, else raw S32_LE stereo) or "null[;fast]":
+// drains at the sample rate from an emulated buffer of bufferFrames.
+class FileSink : public PlaybackSink
+{
+public:
+    ~FileSink() override;
+
+    // opts: "<path>[;fast]" with toFile, else just the options (null sink).
+    static std::unique_ptr<FileSink> open(const std::string &opts, bool toFile, AudioConfig &cfg);
+
+    bool write(size_t frames, FrameRenderer &r) override;
+    long long queuedNs() override;
+
+private:
+    FileSink(const AudioConfig &cfg, bool fast);
+    void pace(size_t n);
+
+    std::FILE *f_ = nullptr;
+    bool wav_ = false;
+    unsigned rate_;
+    Pacer pacer_;
+    size_t period_;
+    long long bufferNs_;
+    std::vector<int32_t> buf_;
+    uint64_t frames_ = 0;
+};
@@ -0,0 +1,130 @@
+#include "HalfbandDecimator.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Odd-branch taps (the non-zero ones besides the 0.5 centre) of a
+// Kaiser-windowed sinc at fs/4, newest first, summing to 0.5.
+static std::vector<double> designOddBranch(unsigned taps)
+{
+    const size_t odd = (taps + 1) / 2;
+    const double beta = 8.0; // ~-80 dB sidelobes
+    const double c = (double)(taps - 1) / 2.0;
+    std::vector<double> g(odd);
+    double sum = 0.0;
+    for (size_t j = 0; j < odd; j++)
+    {
+        const double k = (double)(2 * j);
+        const double x = (k - c) / 2.0;
+        const double r = (k - c) / c;
+        const double w = sbitx::besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / sbitx::besselI0(beta);
+        g[j] = std::sin(M_PI * x) / (M_PI * x) * w;
+        sum += g[j];
+    }
+    for (auto &v : g) v *= 0.5 / sum;
+    return g;
+}
+
+unsigned HalfbandDecimator::validTaps(unsigned taps)
+{
+    const unsigned m = std::max(1u, (taps + 1 + 3) / 4);
+    return 4 * m - 1;
+}
+
+HalfbandDecimator::HalfbandDecimator(unsigned taps)
+{
+    taps_ = validTaps(taps);
+    const size_t m = (taps_ + 1) / 4;
+    odd_ = 2 * m;
+    len_ = (odd_ + sbitx::kSimdWidth - 1) / sbitx::kSimdWidth * sbitx::kSimdWidth;
+
+    // Only the odd branch is stored; the other taps are exactly zero apart
+    // from the 0.5 centre. Unity DC gain overall.
+    const std::vector<double> g = designOddBranch(taps_);
+    coef_.assign(len_, 0.0f);
+    for (size_t j = 0; j < odd_; j++)
+        coef_[len_ - 1 - j] = (float)g[j];
+
+    reset();
+}
+
+void HalfbandDecimator::reset()
+{
+    re_.assign(2 * len_, 0.0f);
+    im_.assign(2 * len_, 0.0f);
+    pos_ = 0;
+    even_.assign(odd_ / 2 - 1, std::complex<float>(0.0f, 0.0f));
+    evenPos_ = 0;
+    havePending_ = false;
+}
+
+inline bool HalfbandDecimator::push(std::complex<float> z, std::complex<float> &y)
+{
+    if (!havePending_)
+    {
+        pending_ = z;
+        havePending_ = true;
+        return false;
+    }
+    havePending_ = false;
+
+    // Odd branch: mirrored write, then one contiguous window of len_.
+    re_[pos_] = re_[pos_ + len_] = z.real();
+    im_[pos_] = im_[pos_ + len_] = z.imag();
+    const size_t w = pos_ + 1;
+    pos_ = (pos_ + 1 == len_) ? 0 : pos_ + 1;
+
+    float accRe, accIm;
+    sbitx::dot2(&re_[w], &im_[w], coef_.data(), len_, accRe, accIm);
+
+    // Even branch: centre tap is a delay of M-1 even samples.
+    std::complex<float> centre = pending_;
+    if (!even_.empty())
+    {
+        centre = even_[evenPos_];
+        even_[evenPos_] = pending_;
+        evenPos_ = (evenPos_ + 1 == even_.size()) ? 0 : evenPos_ + 1;
+    }
+
+    y = std::complex<float>(accRe + 0.5f * centre.real(), accIm + 0.5f * centre.imag());
+    return true;
+}
+
+size_t HalfbandDecimator::mixDecimate(const int32_t *in, size_t stride, size_t frames,
+                                      NCO &nco, std::complex<float> *out)
+{
+    size_t o = 0;
+    for (size_t n = 0; n < frames; n++)
+    {
+        // x * e^{-j ph}
+        const std::complex<float> lo = nco.next();
+        const float x = (float)in[n * stride] / 2147483647.0f;
+        if (push(std::complex<float>(x * lo.real(), -x * lo.imag()), out[o])) o++;
+    }
+    return o;
+}
+
+size_t HalfbandDecimator::mixDecimate2(const int32_t *in, size_t stride, size_t frames, NCO &nco,
+                                       std::complex<float> *out, HalfbandDecimator &ch1,
+                                       std::complex<float> *out1)
+{
+    size_t o = 0;
+    for (size_t n = 0; n < frames; n++)
+    {
+        const std::complex<float> lo = nco.next();
+        const float x = (float)in[n * stride] / 2147483647.0f;
+        const float m = (float)in[n * stride + 1] / 2147483647.0f;
+        ch1.push(std::complex<float>(m, 0.0f), out1[o]);
+        if (push(std::complex<float>(x * lo.real(), -x * lo.imag()), out[o])) o++;
+    }
+    return o;
+}
+
+size_t HalfbandDecimator::decimate(const std::complex<float> *in, size_t n, std::complex<float> *out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < n; i++)
+        if (push(in[i], out[o])) o++;
+    return o;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "NCO.hpp"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decimate-by-2 halfband FIR, fused with the IF mixer.
+//
+// A halfband filter with N = 4M-1 taps has h[c] = 0.5 at the centre and
+// every other tap zero, so in polyphase form one branch is a 2M-tap FIR
+// on the odd input samples and the other is a plain 0.5 * delay on the
+// even ones. Only the non-zero taps are ever multiplied.
+//
+// mixDecimate() reads each capture sample once: it is mixed to baseband
+// and dropped straight into the filter history (split I/Q, mirrored so a
+// full window is always contiguous), and the FIR dot product runs on
+// NEON or SSE where available. History persists across calls, so period
+// boundaries are seamless.
+class HalfbandDecimator
+{
+public:
+    static constexpr unsigned kDefaultTaps = 47;
+
+    explicit HalfbandDecimator(unsigned taps = kDefaultTaps);
+
+    // Nearest valid length (4M-1, at least 3) at or above the request.
+    static unsigned validTaps(unsigned taps);
+
+    unsigned taps() const { return taps_; }
+    void reset();
+
+    // Real input (one channel of interleaved S32 frames, `stride` ints per
+    // frame) mixed down by nco and decimated by 2. Returns outputs written,
+    // at most (frames + 1) / 2.
+    size_t mixDecimate(const int32_t *in, size_t stride, size_t frames,
+                       NCO &nco, std::complex<float> *out);
+
+    // mixDecimate() plus channel 1 of the same frames, unmixed (Q = 0),
+    // into ch1 / out1 in the same pass. ch1 must be in phase (syncPhase).
+    size_t mixDecimate2(const int32_t *in, size_t stride, size_t frames, NCO &nco,
+                        std::complex<float> *out, HalfbandDecimator &ch1, std::complex<float> *out1);
+
+    // Complex input decimated by 2 (for cascading stages).
+    size_t decimate(const std::complex<float> *in, size_t n, std::complex<float> *out);
+
+    // Keep the input/output pairing of `o`, so that from now on both emit
+    // an output on the same input. The pending sample itself is zeroed.
+    void syncPhase(const HalfbandDecimator &o)
+    {
+        havePending_ = o.havePending_;
+        pending_ = std::complex<float>(0.0f, 0.0f);
+    }
+
+private:
+    inline bool push(std::complex<float> z, std::complex<float> &y);
+
+    unsigned taps_ = 0;
+    size_t odd_ = 0;           // non-zero taps on the odd branch (2M)
+    size_t len_ = 0;           // odd_ rounded up to the SIMD width
+    std::vector<float> coef_;  // len_ taps, oldest first, zero padded
+    std::vector<float> re_;    // 2 * len_ mirrored history
+    std::vector<float> im_;
+    size_t pos_ = 0;
+
+    std::vector<std::complex<float>> even_; // centre-tap delay line (M-1)
+    size_t evenPos_ = 0;
+
+    bool havePending_ = false;  // even sample waiting for its odd partner
+    std::complex<float> pending_;
+};
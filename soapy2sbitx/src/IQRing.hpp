@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Wait-free single-producer / multi-reader broadcast ring for IQ samples.
+//
+// Elements are opaque fixed-size records (one complex sample in the RX
+// stream format: 8 bytes for CF32/CS32, 4 for CS16), so the ring carries
+// exactly what readStream hands out and nothing is widened on the way.
+//
+// Every consumer attach()es a Reader with its own cursor and drop count
+// and sees every sample written after it attached; readers never take
+// samples from each other. Single-consumer users (TX, the recorder) just
+// attach one.
+//
+// The writer (RX thread) never waits: when it laps a reader the oldest
+// samples are overwritten (newest data wins), but the reader
+// notices and counts them as dropped instead of losing them silently.
+// A writer that would rather keep the old data checks freeSpace() (room
+// ahead of the slowest reader) and reject()s what does not fit.
+//
+// Indices are free-running 64-bit counters, the slot is (index & mask_).
+// The writer publishes claim_ before copying and head_ after, so a reader
+// that raced with a lapping writer can tell which part of its copy is stale.
+class IQRing
+{
+public:
+    static constexpr size_t kCacheLine = 64;
+    static constexpr unsigned kMaxReaders = 8;
+
+private:
+    struct Slot;
+
+public:
+    // One consumer's view of the ring. Each Reader must only be used by
+    // one thread at a time; different Readers are independent.
+    class Reader
+    {
+    public:
+        bool valid() const { return ring_ != nullptr; }
+
+        // Returns the number of samples copied to out; *index gets the
+        // ring index of the first of them (after any skipped drops).
+        size_t read(void *dst, size_t n, uint64_t *index = nullptr) { return ring_->read(slot(), dst, n, index); }
+
+        // Zero-copy: the next contiguous run of at most maxN samples,
+        // starting at ring index *index. Follow with consume().
+        const void *peek(size_t maxN, size_t &n, uint64_t *index = nullptr)
+        {
+            return ring_->peek(slot(), maxN, n, index);
+        }
+
+        // Release n samples handed out by peek(). Returns how many of them
+        // the writer overwrote while the caller held them (also dropped).
+        size_t consume(size_t n) { return ring_->consume(slot(), n); }
+
+        // If the writer has lapped us, skip to the oldest sample still
+        // intact. Returns how many were skipped (counted as dropped).
+        size_t catchUp() { return ring_->catchUp(slot()); }
+
+        size_t available() const
+        {
+            const uint64_t h = ring_->head_.load(std::memory_order_acquire);
+            return (size_t)std::min<uint64_t>(h - slot().tail.load(std::memory_order_relaxed), ring_->capacity());
+        }
+
+        uint64_t dropped() const { return slot().dropped.load(std::memory_order_relaxed); }
+
+        // The next sample this reader gets.
+        uint64_t readIndex() const { return slot().tail.load(std::memory_order_relaxed); }
+
+    private:
+        friend class IQRing;
+        Slot &slot() const { return ring_->readers_[index_]; }
+
+        IQRing *ring_ = nullptr;
+        unsigned index_ = 0;
+    };
+
+    // Not thread safe: only call while neither side is running. Detaches
+    // every reader.
+    void reset(size_t minCapacity, size_t elemSize)
+    {
+        size_t cap = 1;
+        while (cap < minCapacity) cap <<= 1;
+        elem_ = elemSize;
+        buf_.assign(cap * elem_, 0);
+        mask_ = cap - 1;
+        head_.store(0, std::memory_order_relaxed);
+        claim_.store(0, std::memory_order_relaxed);
+        dropped_.store(0, std::memory_order_relaxed);
+        for (Slot &r : readers_)
+        {
+            r.attached.store(false, std::memory_order_relaxed);
+            r.used.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread, also while the writer runs. The reader starts at the
+    // next sample written. Returns an invalid Reader when all are taken.
+    Reader attach()
+    {
+        Reader rd;
+        for (unsigned i = 0; i < kMaxReaders; i++)
+        {
+            bool expected = false;
+            if (!readers_[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                continue;
+
+            // Invisible to the writer until the cursor is in place
+            readers_[i].tail.store(head_.load(std::memory_order_acquire), std::memory_order_relaxed);
+            readers_[i].dropped.store(0, std::memory_order_relaxed);
+            readers_[i].attached.store(true, std::memory_order_release);
+            rd.ring_ = this;
+            rd.index_ = i;
+            return rd;
+        }
+        return rd;
+    }
+
+    void detach(Reader &rd)
+    {
+        if (!rd.valid()) return;
+        rd.slot().attached.store(false, std::memory_order_release);
+        rd.slot().used.store(false, std::memory_order_release);
+        rd.ring_ = nullptr;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    size_t elemSize() const { return elem_; }
+
+    // Producer side: room left before the next write would lap the slowest
+    // reader (all of it with none attached). Writers that must not drop
+    // (TX) write at most this much.
+    size_t freeSpace() const
+    {
+        const uint64_t h = head_.load(std::memory_order_relaxed);
+        const uint64_t used = h - slowestTail(h);
+        return used >= capacity() ? 0 : capacity() - (size_t)used;
+    }
+
+    // Samples the slowest reader has not read yet.
+    size_t fill() const
+    {
+        const uint64_t h = head_.load(std::memory_order_acquire);
+        return (size_t)std::min<uint64_t>(h - slowestTail(h), capacity());
+    }
+
+    // Producer side. Never blocks, never fails.
+    void write(const void *src, size_t n)
+    {
+        const uint8_t *in = static_cast<const uint8_t *>(src);
+        const size_t cap = capacity();
+        if (n > cap)
+        {
+            // Only the newest cap samples can survive anyway.
+            in += (n - cap) * elem_;
+            n = cap;
+        }
+
+        const uint64_t h = head_.load(std::memory_order_relaxed);
+        claim_.store(h + n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        copyIn(h, in, n);
+
+        head_.store(h + n, std::memory_order_release);
+    }
+
+    // Producer side: n samples thrown away instead of written, counted as
+    // dropped by every reader, like the ones a lapped reader loses.
+    void reject(size_t n)
+    {
+        for (Slot &r : readers_)
+            if (r.attached.load(std::memory_order_acquire)) drop(r, n);
+    }
+
+    // Raw storage, for handing out fixed blocks of the ring by address.
+    void *at(size_t slot) { return &buf_[(slot & mask_) * elem_]; }
+
+    // Samples lost, summed over readers (including detached ones).
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // The next sample the producer writes.
+    uint64_t writeIndex() const { return head_.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(kCacheLine) Slot
+    {
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> used{false};     // slot taken (attach / detach)
+        std::atomic<bool> attached{false}; // cursor valid, the writer may look
+    };
+
+    uint64_t slowestTail(uint64_t h) const
+    {
+        uint64_t t = h;
+        for (const Slot &r : readers_)
+            if (r.attached.load(std::memory_order_acquire))
+                t = std::min(t, r.tail.load(std::memory_order_acquire));
+        // A reader lapped by more than the ring only loses the excess.
+        return std::max(t, h > capacity() ? h - capacity() : 0);
+    }
+
+    void drop(Slot &r, uint64_t n)
+    {
+        r.dropped.fetch_add(n, std::memory_order_relaxed);
+        dropped_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    size_t catchUp(Slot &r)
+    {
+        const uint64_t h = head_.load(std::memory_order_acquire);
+        const uint64_t t = r.tail.load(std::memory_order_relaxed);
+        if (h - t <= capacity()) return 0;
+        const uint64_t nt = h - capacity();
+        drop(r, nt - t);
+        r.tail.store(nt, std::memory_order_release);
+        return (size_t)(nt - t);
+    }
+
+    size_t read(Slot &r, void *dst, size_t n, uint64_t *index)
+    {
+        uint8_t *out = static_cast<uint8_t *>(dst);
+        const uint64_t h = head_.load(std::memory_order_acquire);
+        uint64_t t = r.tail.load(std::memory_order_relaxed);
+
+        if (h - t > capacity())
+        {
+            // Writer lapped us since the last read.
+            const uint64_t nt = h - capacity();
+            drop(r, nt - t);
+            t = nt;
+        }
+
+        size_t take = (size_t)std::min<uint64_t>(n, h - t);
+        if (index) *index = t;
+        if (!take) return 0;
+
+        copyOut(t, out, take);
+
+        // Anything older than claim_ - capacity may have been overwritten
+        // while we were copying; discard that prefix.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t c = claim_.load(std::memory_order_relaxed);
+        if (c > capacity() && c - capacity() > t)
+        {
+            const size_t stale = (size_t)std::min<uint64_t>(take, c - capacity() - t);
+            drop(r, stale);
+            take -= stale;
+            t += stale;
+            if (take) std::memmove(out, out + stale * elem_, take * elem_);
+        }
+        if (index) *index = t;
+
+        r.tail.store(t + take, std::memory_order_release);
+        return take;
+    }
+
+    const void *peek(Slot &r, size_t maxN, size_t &n, uint64_t *index)
+    {
+        const uint64_t h = head_.load(std::memory_order_acquire);
+        uint64_t t = r.tail.load(std::memory_order_relaxed);
+
+        if (h - t > capacity())
+        {
+            const uint64_t nt = h - capacity();
+            drop(r, nt - t);
+            t = nt;
+            r.tail.store(t, std::memory_order_release);
+        }
+
+        const size_t pos = (size_t)(t & mask_);
+        n = (size_t)std::min<uint64_t>(std::min<uint64_t>(maxN, h - t), capacity() - pos);
+        if (index) *index = t;
+        return &buf_[pos * elem_];
+    }
+
+    size_t consume(Slot &r, size_t n)
+    {
+        const uint64_t t = r.tail.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t c = claim_.load(std::memory_order_relaxed);
+        size_t stale = 0;
+        if (c > capacity() && c - capacity() > t)
+        {
+            stale = (size_t)std::min<uint64_t>(n, c - capacity() - t);
+            drop(r, stale);
+        }
+        r.tail.store(t + n, std::memory_order_release);
+        return stale;
+    }
+
+    void copyIn(uint64_t idx, const uint8_t *in, size_t n)
+    {
+        const size_t pos = (size_t)(idx & mask_);
+        const size_t first = std::min(n, capacity() - pos);
+        std::memcpy(&buf_[pos * elem_], in, first * elem_);
+        if (n > first) std::memcpy(&buf_[0], in + first * elem_, (n - first) * elem_);
+    }
+
+    void copyOut(uint64_t idx, uint8_t *out, size_t n) const
+    {
+        const size_t pos = (size_t)(idx & mask_);
+        const size_t first = std::min(n, capacity() - pos);
+        std::memcpy(out, &buf_[pos * elem_], first * elem_);
+        if (n > first) std::memcpy(out + first * elem_, &buf_[0], (n - first) * elem_);
+    }
+
+    std::vector<uint8_t> buf_;
+    size_t elem_ = 1;
+    size_t mask_ = 0;
+
+    // Producer-owned
+    alignas(kCacheLine) std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> claim_{0};
+
+    // One cache line per reader
+    Slot readers_[kMaxReaders];
+    alignas(kCacheLine) std::atomic<uint64_t> dropped_{0};
+};
@@ -0,0 +1,543 @@
+#include "IQServer.hpp"
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+// readStream wait per pass; also bounds command latency while streaming
+static const long kReadTimeoutUs = 20000;
+
+// poll timeout with nobody connected (accept latency, shutdown)
+static const int kIdlePollMs = 100;
+
+// Per-client send queue: a client further behind than this loses blocks.
+static const unsigned kQueueSeconds = 1;
+
+static const size_t kMaxClients = 8;
+static const size_t kMaxIov = 16;
+
+// rtl_tcp commands (5 bytes: command, big endian argument)
+static const uint8_t kCmdFrequency = 0x01;
+static const uint8_t kCmdSampleRate = 0x02;
+static const uint8_t kCmdGain = 0x04; // tenths of a dB
+
+// Completion ids wrap at 32 bits.
+static bool seqBefore(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static void putBe32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static size_t wireBytes(IQServer::Format fmt)
+{
+    switch (fmt)
+    {
+    case IQServer::FMT_CU8:
+    case IQServer::FMT_CS8: return 2;
+    case IQServer::FMT_CS16: return 4;
+    case IQServer::FMT_CF32: return 8;
+    }
+    return 8;
+}
+
+bool IQServer::parseFormat(const std::string &name, Format &fmt)
+{
+    for (Format f : {FMT_CU8, FMT_CS8, FMT_CS16, FMT_CF32})
+    {
+        if (name == formatName(f))
+        {
+            fmt = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *IQServer::formatName(Format fmt)
+{
+    switch (fmt)
+    {
+    case FMT_CU8: return "cu8";
+    case FMT_CS8: return "cs8";
+    case FMT_CS16: return "cs16";
+    case FMT_CF32: return "cf32";
+    }
+    return "?";
+}
+
+IQServer::IQServer(SoapySDR::Device &dev, const std::string &hostPort, Format fmt)
+    : dev_(dev), fmt_(fmt), addr_(hostPort)
+{
+    const size_t colon = hostPort.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("SBITX: serve must be host:port");
+    const std::string host = hostPort.substr(0, colon);
+    const std::string port = hostPort.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0 || !res)
+        throw std::runtime_error("SBITX: serve: cannot resolve " + hostPort);
+
+    for (addrinfo *p = res; p; p = p->ai_next)
+    {
+        const int fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+        if (fd < 0) continue;
+        const int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, p->ai_addr, p->ai_addrlen) == 0 && listen(fd, 4) == 0)
+        {
+            listenFd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(res);
+    if (listenFd_ < 0)
+        throw std::runtime_error("SBITX: serve: cannot listen on " + hostPort + ": " + std::strerror(errno));
+
+    run_.store(true);
+    thread_ = std::thread(&IQServer::threadMain, this);
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX serve: listening on %s (%s)", addr_.c_str(), formatName(fmt_));
+}
+
+IQServer::~IQServer()
+{
+    run_.store(false);
+    if (thread_.joinable()) thread_.join();
+    ::close(listenFd_);
+}
+
+void IQServer::threadMain()
+{
+    std::vector<pollfd> pfds;
+    while (run_.load())
+    {
+        // Stream only while somebody listens.
+        if (!clients_.empty() && !stream_ && !openStream())
+        {
+            SoapySDR::log(SOAPY_SDR_ERROR, "SBITX serve: no RX stream available, dropping clients");
+            for (auto &c : clients_) c->dead = true;
+        }
+        else if (clients_.empty() && stream_)
+        {
+            closeStream();
+        }
+
+        if (stream_) pump();
+
+        pfds.clear();
+        pfds.push_back(pollfd{listenFd_, POLLIN, 0});
+        for (auto &c : clients_)
+            pfds.push_back(pollfd{c->fd, (short)(POLLIN | (c->sending < c->queue.size() ? POLLOUT : 0)), 0});
+
+        // pump() already waited for samples
+        if (poll(pfds.data(), pfds.size(), stream_ ? 0 : kIdlePollMs) > 0)
+        {
+            for (size_t i = 0; i < clients_.size(); i++)
+            {
+                Client &c = *clients_[i];
+                const short ev = pfds[i + 1].revents;
+                if (ev & POLLERR) completions(c);
+                if (ev & (POLLIN | POLLHUP)) receive(c);
+                if (ev & POLLOUT) flush(c);
+            }
+            if (pfds[0].revents & POLLIN) accept();
+        }
+
+        for (size_t i = 0; i < clients_.size();)
+        {
+            if (clients_[i]->dead)
+            {
+                drop(*clients_[i]);
+                clients_.erase(clients_.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        numClients_.store(clients_.size(), std::memory_order_relaxed);
+    }
+
+    for (auto &c : clients_) drop(*c);
+    clients_.clear();
+    numClients_.store(0, std::memory_order_relaxed);
+    closeStream();
+}
+
+bool IQServer::openStream()
+{
+    // follow=1: CF32 out of whatever format and channels the application's
+    // streams pick, before or after us, so the server never fixes them.
+    mtu_ = 0;
+    try
+    {
+        stream_ = dev_.setupStream(SOAPY_SDR_RX, SOAPY_SDR_CF32, {0}, {{"follow", "1"}});
+    }
+    catch (const std::exception &e)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX serve: %s", e.what());
+        return false;
+    }
+
+    if (dev_.activateStream(stream_) != 0)
+    {
+        dev_.closeStream(stream_);
+        stream_ = nullptr;
+        return false;
+    }
+
+    mtu_ = dev_.getStreamMTU(stream_);
+    rate_ = (unsigned)std::lround(dev_.getSampleRate(SOAPY_SDR_RX, 0));
+    iq_.resize(mtu_ * 2);
+    return true;
+}
+
+void IQServer::closeStream()
+{
+    if (!stream_) return;
+    dev_.deactivateStream(stream_);
+    dev_.closeStream(stream_);
+    stream_ = nullptr;
+}
+
+// One readStream, encoded once, queued for everyone.
+void IQServer::pump()
+{
+    void *buffs[] = {iq_.data()};
+    int flags = 0;
+    long long timeNs = 0;
+    const int r = dev_.readStream(stream_, buffs, mtu_, flags, timeNs, kReadTimeoutUs);
+    if (r <= 0) return; // timeout, or OVERFLOW: the next read carries on after the gap
+
+    const size_t n = (size_t)r;
+
+    // The rate is device-wide and may change under us; new clients' headers
+    // pick it up.
+    rate_ = (unsigned)std::lround(dev_.getSampleRate(SOAPY_SDR_RX, 0));
+
+    const std::shared_ptr<const Block> b = encode(iq_.data(), n);
+    for (auto &c : clients_)
+    {
+        if (c->dead) continue;
+        enqueue(*c, b);
+        flush(*c);
+    }
+}
+
+std::shared_ptr<const IQServer::Block> IQServer::encode(const float *iq, size_t n) const
+{
+    auto b = std::make_shared<Block>();
+    b->samples = n;
+    const size_t m = 2 * n;
+
+    switch (fmt_)
+    {
+    case FMT_CU8:
+        b->bytes.resize(m);
+        for (size_t i = 0; i < m; i++)
+            b->bytes[i] = (uint8_t)std::clamp(std::lround(iq[i] * 127.5f + 127.5f), 0L, 255L);
+        break;
+
+    case FMT_CS8:
+    {
+        // [u32 LE samples][f32 LE scale][samples x (i8 I, i8 Q)], value * scale
+        float peak = 0.0f;
+        for (size_t i = 0; i < m; i++) peak = std::max(peak, std::fabs(iq[i]));
+        const float scale = peak > 0.0f ? peak / 127.0f : 1.0f / 127.0f;
+        const float inv = 1.0f / scale;
+        const uint32_t count = (uint32_t)n;
+
+        b->bytes.resize(8 + m);
+        std::memcpy(&b->bytes[0], &count, 4);
+        std::memcpy(&b->bytes[4], &scale, 4);
+        int8_t *out = reinterpret_cast<int8_t *>(&b->bytes[8]);
+        for (size_t i = 0; i < m; i++)
+            out[i] = (int8_t)std::clamp(std::lround(iq[i] * inv), -127L, 127L);
+        break;
+    }
+
+    case FMT_CS16:
+    {
+        b->bytes.resize(m * sizeof(int16_t));
+        int16_t *out = reinterpret_cast<int16_t *>(b->bytes.data());
+        for (size_t i = 0; i < m; i++)
+            out[i] = (int16_t)std::clamp(std::lround(iq[i] * 32767.0f), -32767L, 32767L);
+        break;
+    }
+
+    case FMT_CF32:
+        b->bytes.resize(m * sizeof(float));
+        std::memcpy(b->bytes.data(), iq, m * sizeof(float));
+        break;
+    }
+    return b;
+}
+
+// rtl_tcp's 12-byte greeting: "RTL0", tuner type, gain count. Other formats
+// say "SBX0", the format and the sample rate instead, so clients cannot
+// mistake them for rtl_tcp.
+std::shared_ptr<const IQServer::Block> IQServer::header() const
+{
+    auto b = std::make_shared<Block>();
+    b->samples = 0;
+    b->bytes.resize(12);
+    if (fmt_ == FMT_CU8)
+    {
+        std::memcpy(&b->bytes[0], "RTL0", 4);
+        putBe32(&b->bytes[4], 0); // unknown tuner
+        putBe32(&b->bytes[8], 0); // no gain table
+    }
+    else
+    {
+        std::memcpy(&b->bytes[0], "SBX0", 4);
+        putBe32(&b->bytes[4], (uint32_t)fmt_);
+        putBe32(&b->bytes[8], rate_);
+    }
+    return b;
+}
+
+void IQServer::accept()
+{
+    for (;;)
+    {
+        sockaddr_storage sa{};
+        socklen_t len = sizeof(sa);
+        const int fd = accept4(listenFd_, reinterpret_cast<sockaddr *>(&sa), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        char host[NI_MAXHOST] = "?", serv[NI_MAXSERV] = "?";
+        getnameinfo(reinterpret_cast<sockaddr *>(&sa), len, host, sizeof(host), serv, sizeof(serv),
+                    NI_NUMERICHOST | NI_NUMERICSERV);
+        if (clients_.size() >= kMaxClients)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX serve: refusing %s:%s (%lu clients)", host, serv,
+                           (unsigned long)clients_.size());
+            ::close(fd);
+            continue;
+        }
+
+        std::unique_ptr<Client> c(new Client);
+        c->fd = fd;
+        c->peer = std::string(host) + ":" + serv;
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+        const int one = 1;
+        c->zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+        // Until the stream is open, the header only knows the current rate.
+        if (!stream_) rate_ = (unsigned)std::lround(dev_.getSampleRate(SOAPY_SDR_RX, 0));
+        enqueue(*c, header());
+        SoapySDR::logf(SOAPY_SDR_INFO, "SBITX serve: %s connected%s", c->peer.c_str(),
+                       c->zerocopy ? " (zerocopy)" : "");
+        clients_.push_back(std::move(c));
+    }
+}
+
+void IQServer::enqueue(Client &c, const std::shared_ptr<const Block> &b)
+{
+    // Whole blocks only, so a drop never splits a sample or a CS8 frame.
+    const size_t limit = (size_t)std::max(rate_, 48000u) * wireBytes(fmt_) * kQueueSeconds;
+    if (b->samples && c.unsent + b->bytes.size() > limit)
+    {
+        c.dropped += b->samples;
+        dropped_.fetch_add(b->samples, std::memory_order_relaxed);
+        return;
+    }
+    Pending p;
+    p.block = b;
+    c.queue.push_back(std::move(p));
+    c.unsent += b->bytes.size();
+}
+
+void IQServer::flush(Client &c)
+{
+    while (!c.dead && c.sending < c.queue.size())
+    {
+        iovec iov[kMaxIov];
+        size_t niov = 0;
+        for (size_t i = c.sending; i < c.queue.size() && niov < kMaxIov; i++, niov++)
+        {
+            const Pending &p = c.queue[i];
+            iov[niov].iov_base = const_cast<uint8_t *>(p.block->bytes.data() + p.sent);
+            iov[niov].iov_len = p.block->bytes.size() - p.sent;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = niov;
+        const int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        bool zc = c.zerocopy;
+        ssize_t w = -1;
+#ifdef MSG_ZEROCOPY
+        if (zc)
+        {
+            w = sendmsg(c.fd, &msg, flags | MSG_ZEROCOPY);
+            if (w < 0 && errno == ENOBUFS) zc = false; // pinned-page budget used up; copy this one
+        }
+#endif
+        if (!zc) w = sendmsg(c.fd, &msg, flags);
+
+        if (w < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) c.dead = true;
+            break;
+        }
+
+        // Every successful MSG_ZEROCOPY send takes the next completion id.
+        const uint32_t seq = zc ? c.zcNext++ : 0;
+        size_t left = (size_t)w;
+        c.unsent -= left;
+        while (left)
+        {
+            Pending &p = c.queue[c.sending];
+            const size_t take = std::min(left, p.block->bytes.size() - p.sent);
+            p.sent += take;
+            left -= take;
+            if (zc)
+            {
+                p.zc = true;
+                p.lastSeq = seq;
+            }
+            if (p.sent == p.block->bytes.size()) c.sending++;
+        }
+    }
+    release(c);
+}
+
+// Zerocopy completions arrive on the socket error queue (POLLERR).
+void IQServer::completions(Client &c)
+{
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    for (;;)
+    {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(c.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            const bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr) continue;
+            sock_extended_err ee;
+            std::memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee.ee_errno != 0) continue;
+
+            // [ee_info, ee_data] are done; TCP completes them in order.
+            if (!seqBefore(ee.ee_data, c.zcDone)) c.zcDone = ee.ee_data + 1;
+
+            // The kernel copied anyway (loopback, no scatter-gather NIC):
+            // plain sends are cheaper than the completion round trip.
+            if ((ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && c.zerocopy)
+            {
+                c.zerocopy = false;
+                SoapySDR::logf(SOAPY_SDR_DEBUG, "SBITX serve: %s: kernel copies, zerocopy off", c.peer.c_str());
+            }
+        }
+    }
+#endif
+    release(c);
+}
+
+// Drop sent blocks from the front once the kernel no longer needs them.
+void IQServer::release(Client &c)
+{
+    while (c.sending && (!c.queue.front().zc || seqBefore(c.queue.front().lastSeq, c.zcDone)))
+    {
+        c.queue.pop_front();
+        c.sending--;
+    }
+}
+
+void IQServer::receive(Client &c)
+{
+    for (;;)
+    {
+        const ssize_t r = recv(c.fd, c.cmd + c.cmdFill, sizeof(c.cmd) - c.cmdFill, MSG_DONTWAIT);
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            c.dead = true;
+            return;
+        }
+        if (r < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        c.cmdFill += (size_t)r;
+        if (c.cmdFill == sizeof(c.cmd))
+        {
+            command(c, c.cmd[0], ((uint32_t)c.cmd[1] << 24) | ((uint32_t)c.cmd[2] << 16) |
+                                     ((uint32_t)c.cmd[3] << 8) | c.cmd[4]);
+            c.cmdFill = 0;
+        }
+    }
+}
+
+void IQServer::command(Client &c, uint8_t cmd, uint32_t arg)
+{
+    switch (cmd)
+    {
+    case kCmdFrequency:
+        dev_.setFrequency(SOAPY_SDR_RX, 0, (double)arg);
+        break;
+
+    case kCmdGain:
+        dev_.setGain(SOAPY_SDR_RX, 0, (int32_t)arg / 10.0);
+        break;
+
+    case kCmdSampleRate:
+        // Device-wide and shared with the other streams: not the client's call.
+        if (arg != rate_ && !c.rateWarned)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX serve: %s asked for %u Hz, the stream runs at %u Hz",
+                           c.peer.c_str(), arg, rate_);
+            c.rateWarned = true;
+        }
+        break;
+
+    default:
+        // AGC, PPM, gain mode etc.: nothing to do on this radio
+        break;
+    }
+}
+
+void IQServer::drop(Client &c)
+{
+    ::close(c.fd);
+    c.fd = -1;
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX serve: %s disconnected, %llu samples dropped",
+                   c.peer.c_str(), (unsigned long long)c.dropped);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <SoapySDR/Device.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// rtl_tcp-style IQ server (serve=host:port).
+//
+// The server is one more client of the device: while anyone is connected
+// it keeps its own RX stream open (a reader on the broadcast ring, so it
+// takes nothing from the other streams; follow=1, so it adapts to their
+// format instead of fixing it) and fans each block out to every client. Blocks are encoded once and shared; each client has its own send
+// queue, so a slow client drops its own blocks and nobody else's. Sends use
+// MSG_ZEROCOPY where the kernel supports it; a block stays queued until
+// the kernel reports it done with the pages.
+//
+// Client commands are rtl_tcp's 5-byte frames (1 byte command, 4 bytes big
+// endian argument); frequency and gain are forwarded to the device.
+class IQServer
+{
+public:
+    enum Format
+    {
+        FMT_CU8,  // rtl_tcp's own: offset binary, what stock clients expect
+        FMT_CS8,  // signed 8 bit, scaled per block (header carries the scale)
+        FMT_CS16,
+        FMT_CF32,
+    };
+
+    static bool parseFormat(const std::string &name, Format &fmt);
+    static const char *formatName(Format fmt);
+
+    // Binds and starts serving. Throws std::runtime_error when the address
+    // cannot be bound.
+    IQServer(SoapySDR::Device &dev, const std::string &hostPort, Format fmt);
+    ~IQServer();
+
+    size_t clients() const { return numClients_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    // One encoded block, shared by every client's queue
+    struct Block
+    {
+        std::vector<uint8_t> bytes;
+        size_t samples;
+    };
+
+    struct Pending
+    {
+        std::shared_ptr<const Block> block;
+        size_t sent = 0;
+        bool zc = false;      // some of it went out with MSG_ZEROCOPY
+        uint32_t lastSeq = 0; // ... the last of those sends
+    };
+
+    struct Client
+    {
+        int fd = -1;
+        std::string peer;
+        bool zerocopy = false;
+        uint32_t zcNext = 0; // id of the next MSG_ZEROCOPY send
+        uint32_t zcDone = 0; // every send before this id has completed
+        std::deque<Pending> queue;
+        size_t sending = 0;  // queue[0, sending) is sent, maybe not completed
+        size_t unsent = 0;   // bytes
+        uint8_t cmd[5];
+        size_t cmdFill = 0;
+        uint64_t dropped = 0; // samples
+        bool rateWarned = false;
+        bool dead = false;
+    };
+
+    void threadMain();
+    bool openStream();
+    void closeStream();
+    void pump();
+    std::shared_ptr<const Block> encode(const float *iq, size_t n) const;
+    std::shared_ptr<const Block> header() const;
+
+    void accept();
+    void enqueue(Client &c, const std::shared_ptr<const Block> &b);
+    void flush(Client &c);
+    void completions(Client &c);
+    void release(Client &c);
+    void receive(Client &c);
+    void command(Client &c, uint8_t cmd, uint32_t arg);
+    void drop(Client &c);
+
+    SoapySDR::Device &dev_;
+    const Format fmt_;
+    std::string addr_;
+    int listenFd_ = -1;
+
+    // Server thread only
+    std::vector<std::unique_ptr<Client>> clients_;
+    SoapySDR::Stream *stream_ = nullptr;
+    unsigned rate_ = 0;
+    size_t mtu_ = 0;
+    std::vector<float> iq_;
+
+    std::thread thread_;
+    std::atomic<bool> run_{false};
+    std::atomic<size_t> numClients_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
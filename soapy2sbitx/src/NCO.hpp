@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// Numerically controlled oscillator.
+//
+// Frequency and phase live in a 32-bit integer accumulator, so the tuning
+// word is exact and the phase never drifts however long the stream runs
+// (24 kHz @ 96 kHz is exactly 2^30 per sample).
+//
+// Samples come from a recursive complex rotator (two mul-adds per sample,
+// no trig). Every kResync samples the rotator is reloaded from the
+// accumulator, which both renormalises its magnitude and removes the
+// rounding error the recursion has picked up; that is the only place
+// sin/cos are evaluated.
+class NCO
+{
+public:
+    static constexpr unsigned kResync = 32;
+
+    NCO() { setStep(0); }
+
+    void setFrequency(double hz, double fs)
+    {
+        // Wrap into [-fs/2, fs/2) first, then scale to a signed tuning word.
+        double f = std::fmod(hz / fs, 1.0);
+        if (f >= 0.5) f -= 1.0;
+        if (f < -0.5) f += 1.0;
+        setStep((uint32_t)(int32_t)std::llround(f * 4294967296.0));
+    }
+
+    void setStep(uint32_t step)
+    {
+        step_ = step;
+        const double a = angle(step_);
+        stepRe_ = (float)std::cos(a);
+        stepIm_ = (float)std::sin(a);
+        left_ = 0;
+    }
+
+    void setPhase(uint32_t phase)
+    {
+        phase_ = phase;
+        left_ = 0;
+    }
+
+    uint32_t step() const { return step_; }
+    uint32_t phase() const { return phase_; }
+
+    // Returns e^{+j*phase} and advances by one sample.
+    inline std::complex<float> next()
+    {
+        if (left_ == 0) resync();
+        const float re = re_, im = im_;
+        // Written out: std::complex<float>::operator* carries NaN/Inf
+        // fix-ups (__mulsc3) unless built with -ffast-math.
+        re_ = re * stepRe_ - im * stepIm_;
+        im_ = re * stepIm_ + im * stepRe_;
+        phase_ += step_;
+        left_--;
+        return std::complex<float>(re, im);
+    }
+
+private:
+    static double angle(uint32_t p)
+    {
+        return (double)p * (2.0 * M_PI / 4294967296.0);
+    }
+
+    void resync()
+    {
+        const double a = angle(phase_);
+        re_ = (float)std::cos(a);
+        im_ = (float)std::sin(a);
+        left_ = kResync;
+    }
+
+    uint32_t phase_ = 0;
+    uint32_t step_ = 0;
+    float stepRe_ = 1.0f, stepIm_ = 0.0f;
+    float re_ = 1.0f, im_ = 0.0f;
+    unsigned left_ = 0;
+};
@@ -0,0 +1,114 @@
+#include "RealTime.hpp"
+
+#include <SoapySDR/Logger.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+// Stack an RT thread touches up front; far more than any loop here uses.
+static const size_t kStackPrefault = 128 * 1024;
+
+bool sbitx::parseCpuList(const std::string &s, std::vector<int> &cpus)
+{
+    cpus.clear();
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t end = s.find(';', pos);
+        if (end == std::string::npos) end = s.size();
+        const std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+
+        char *e = nullptr;
+        const long lo = std::strtol(item.c_str(), &e, 10);
+        long hi = lo;
+        if (e == item.c_str()) return false;
+        if (*e == '-')
+        {
+            const char *h = e + 1;
+            hi = std::strtol(h, &e, 10);
+            if (e == h) return false;
+        }
+        if (*e || lo < 0 || hi < lo || hi >= 1024) return false;
+        for (long c = lo; c <= hi; c++) cpus.push_back((int)c);
+    }
+    return !cpus.empty();
+}
+
+std::string sbitx::cpuListName(const std::vector<int> &cpus)
+{
+    if (cpus.empty()) return "any";
+    std::string out;
+    for (int c : cpus) out += (out.empty() ? "" : ";") + std::to_string(c);
+    return out;
+}
+
+#ifdef __linux__
+// Not inlined, so the array really lives below the caller's frame.
+__attribute__((noinline)) static void prefaultStack()
+{
+    volatile unsigned char stack[kStackPrefault];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) stack[i] = 0;
+}
+#endif
+
+bool sbitx::enterThread(const ThreadProfile &p, const char *name)
+{
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), name);
+
+    bool ok = true;
+    if (!p.cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : p.cpus)
+            if (c < CPU_SETSIZE) CPU_SET(c, &set);
+        if (const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: %s: cannot pin to cpu=%s (%s)",
+                           name, cpuListName(p.cpus).c_str(), std::strerror(rc));
+            ok = false;
+        }
+    }
+    if (p.fifoPrio > 0)
+    {
+        sched_param sp{};
+        sp.sched_priority = p.fifoPrio;
+        if (const int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp))
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: %s: SCHED_FIFO %d refused (%s); needs CAP_SYS_NICE or an rtprio limit",
+                           name, p.fifoPrio, std::strerror(rc));
+            ok = false;
+        }
+        prefaultStack();
+    }
+    return ok;
+#else
+    (void)p;
+    (void)name;
+    return true;
+#endif
+}
+
+bool sbitx::lockMemory()
+{
+#ifdef __linux__
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX: mlockall failed (%s); raise the memlock limit (ulimit -l, LimitMEMLOCK=)",
+                       std::strerror(errno));
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
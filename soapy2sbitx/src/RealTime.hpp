@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// How a driver thread runs (rt=, rt_prio=, cpu=). Each thread applies its
+// own profile first thing, before its loop, so it never runs a period
+// under the default policy or on the wrong core.
+struct ThreadProfile
+{
+    std::vector<int> cpus; // empty: wherever the scheduler puts it
+    int fifoPrio = 0;      // > 0: SCHED_FIFO at this priority
+};
+
+namespace sbitx
+{
+
+// "3", "2-3", "0;2-3" (';' because Soapy splits args on ','). False if
+// malformed.
+bool parseCpuList(const std::string &s, std::vector<int> &cpus);
+std::string cpuListName(const std::vector<int> &cpus);
+
+// Call from the thread itself. Names it, pins it, sets its policy, and for
+// FIFO threads touches the stack it will use. Logs and returns false if
+// any of that was refused; the thread then runs anyway.
+bool enterThread(const ThreadProfile &p, const char *name);
+
+// mlockall(current and future): nothing the process has or maps later is
+// paged out, or faulted in on an RT thread's first touch. Process-wide,
+// and never undone. Logs and returns false when refused (RLIMIT_MEMLOCK).
+bool lockMemory();
+
+} // namespace sbitx
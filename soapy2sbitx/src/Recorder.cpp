@@ -0,0 +1,271 @@
+#include "Recorder.hpp"
+
+#include <SoapySDR/Logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+static const size_t kBlockBytes = 1 << 20;
+static const size_t kBlockAlign = 4096;
+static const unsigned kQueueSeconds = 4;
+static const size_t kMaxCaptures = 4096;
+
+static long long clockNs(clockid_t id)
+{
+    timespec ts{};
+    clock_gettime(id, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// "base", "base.sigmf", "base.sigmf-data" and "base.sigmf-meta" all name
+// the same recording.
+static std::string sigmfBase(const std::string &path)
+{
+    for (const char *ext : {".sigmf-data", ".sigmf-meta", ".sigmf"})
+    {
+        const size_t n = std::strlen(ext);
+        if (path.size() > n && path.compare(path.size() - n, n, ext) == 0)
+            return path.substr(0, path.size() - n);
+    }
+    return path;
+}
+
+static std::string isoTime(long long wallNs)
+{
+    const time_t secs = (time_t)(wallNs / 1000000000LL);
+    tm t{};
+    gmtime_r(&secs, &t);
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%06lldZ",
+                  t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                  (wallNs % 1000000000LL) / 1000);
+    return buf;
+}
+
+IQRecorder::~IQRecorder()
+{
+    stop();
+    std::free(block_);
+}
+
+bool IQRecorder::start(const std::string &base, const Format &fmt, bool direct, long long freqHz)
+{
+    stop();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    base_ = sigmfBase(base);
+    fmt_ = fmt;
+    const std::string data = base_ + ".sigmf-data";
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    direct_ = false;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        fd_ = ::open(data.c_str(), flags | O_DIRECT, 0644);
+        direct_ = fd_ >= 0;
+        if (!direct_)
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX record: O_DIRECT refused on %s (%s), using the page cache",
+                           data.c_str(), std::strerror(errno));
+    }
+#endif
+    if (fd_ < 0) fd_ = ::open(data.c_str(), flags, 0644);
+    if (fd_ < 0)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX record: cannot create %s: %s", data.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    if (!block_ && posix_memalign(reinterpret_cast<void **>(&block_), kBlockAlign, kBlockBytes) != 0)
+    {
+        block_ = nullptr;
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    blockFill_ = 0;
+    failed_ = false;
+
+    queue_.reset((size_t)fmt_.rate * kQueueSeconds, fmt_.sampleBytes);
+    queueReader_ = queue_.attach();
+    captures_.clear();
+    captures_.reserve(kMaxCaptures);
+    wallOffsetNs_ = clockNs(CLOCK_REALTIME) - clockNs(CLOCK_MONOTONIC);
+    samples_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    missed_.store(0, std::memory_order_relaxed);
+    lastFreqHz_ = freqHz;
+    gap_ = true; // the first push opens the first capture segment
+
+    run_.store(true);
+    writer_ = std::thread(&IQRecorder::writerMain, this);
+    active_.store(true, std::memory_order_release);
+
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX record: %s (%s @ %u Hz%s)", data.c_str(), fmt_.datatype.c_str(),
+                   fmt_.rate, direct_ ? ", O_DIRECT" : "");
+    return true;
+}
+
+void IQRecorder::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active_.exchange(false)) return;
+    }
+
+    run_.store(false);
+    stopBell_.ring();
+    if (writer_.joinable()) writer_.join();
+
+    writeMeta();
+    ::close(fd_);
+    fd_ = -1;
+    SoapySDR::logf(SOAPY_SDR_INFO, "SBITX record: stopped %s, %llu samples, %llu dropped",
+                   base_.c_str(), (unsigned long long)samples(), (unsigned long long)dropped());
+}
+
+std::string IQRecorder::path() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_.load() ? base_ : std::string();
+}
+
+void IQRecorder::push(const void *data, size_t n, unsigned rate, long long timeNs, long long freqHz)
+{
+    if (!active_.load(std::memory_order_relaxed) || !n) return;
+
+    // Never wait for the lock: whoever holds it only does so briefly, and
+    // the samples missed meanwhile are counted as dropped. The counters
+    // have a single writer, so plain load + store, no locked instruction.
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        missed_.store(missed_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        return;
+    }
+    if (!active_.load(std::memory_order_relaxed)) return;
+
+    const bool fits = rate == fmt_.rate && queue_.freeSpace() >= n;
+    const uint64_t lost = missed_.load(std::memory_order_relaxed) + (fits ? 0 : n);
+    missed_.store(0, std::memory_order_relaxed);
+    if (lost)
+    {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + lost, std::memory_order_relaxed);
+        gap_ = true;
+    }
+    if (!fits) return;
+
+    const uint64_t at = samples_.load(std::memory_order_relaxed);
+    if ((gap_ || freqHz != lastFreqHz_) && captures_.size() < captures_.capacity())
+        captures_.push_back(Capture{at, freqHz, timeNs});
+    gap_ = false;
+    lastFreqHz_ = freqHz;
+
+    queue_.write(data, n);
+    samples_.store(at + n, std::memory_order_relaxed);
+}
+
+void IQRecorder::writerMain()
+{
+#ifdef __linux__
+    // Background work: lowest best-effort I/O class, nice 10.
+    const pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t)tid, 10);
+    syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, (2 << 13) | 7 /* BE, level 7 */);
+#endif
+
+    const size_t elem = fmt_.sampleBytes;
+    for (;;)
+    {
+        const bool running = run_.load();
+        while (queueReader_.available())
+        {
+            size_t n = 0;
+            const void *p = queueReader_.peek((kBlockBytes - blockFill_) / elem, n);
+            if (!n) break;
+            std::memcpy(block_ + blockFill_, p, n * elem);
+            queueReader_.consume(n);
+            blockFill_ += n * elem;
+
+            // Whole blocks only (O_DIRECT wants aligned sizes); a sample
+            // straddling the block end waits for the next one.
+            if (kBlockBytes - blockFill_ < elem)
+            {
+                const size_t whole = blockFill_ / kBlockAlign * kBlockAlign;
+                flush(whole);
+                std::memmove(block_, block_ + whole, blockFill_ - whole);
+                blockFill_ -= whole;
+            }
+        }
+        if (!running) break;
+        stopBell_.waitFor([&] { return !run_.load(); }, 50000);
+    }
+
+    // The tail is not a whole block: finish it through the page cache.
+#ifdef O_DIRECT
+    if (direct_) fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+#endif
+    flush(blockFill_);
+    blockFill_ = 0;
+}
+
+bool IQRecorder::flush(size_t bytes)
+{
+    if (failed_) return false;
+    for (size_t done = 0; done < bytes;)
+    {
+        const ssize_t w = ::write(fd_, block_ + done, bytes - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX record: write failed: %s, discarding the rest",
+                           w < 0 ? std::strerror(errno) : "short write");
+            failed_ = true;
+            return false;
+        }
+        done += (size_t)w;
+    }
+    return true;
+}
+
+void IQRecorder::writeMeta()
+{
+    const std::string meta = base_ + ".sigmf-meta";
+    std::FILE *f = std::fopen(meta.c_str(), "w");
+    if (!f)
+    {
+        SoapySDR::logf(SOAPY_SDR_ERROR, "SBITX record: cannot create %s: %s", meta.c_str(), std::strerror(errno));
+        return;
+    }
+
+    std::fprintf(f, "{\n  \"global\": {\n");
+    std::fprintf(f, "    \"core:datatype\": \"%s\",\n", fmt_.datatype.c_str());
+    std::fprintf(f, "    \"core:sample_rate\": %u,\n", fmt_.rate);
+    if (fmt_.channels > 1) std::fprintf(f, "    \"core:num_channels\": %u,\n", fmt_.channels);
+    std::fprintf(f, "    \"core:version\": \"1.0.0\",\n");
+    std::fprintf(f, "    \"core:hw\": \"sBitx\",\n");
+    std::fprintf(f, "    \"core:recorder\": \"SoapySBITX\",\n");
+    std::fprintf(f, "    \"core:description\": \"%s\"\n", fmt_.description.c_str());
+    std::fprintf(f, "  },\n  \"captures\": [");
+    for (size_t i = 0; i < captures_.size(); i++)
+    {
+        const Capture &c = captures_[i];
+        std::fprintf(f, "%s\n    {\"core:sample_start\": %llu, \"core:frequency\": %lld, \"core:datetime\": \"%s\"}",
+                     i ? "," : "", (unsigned long long)c.sampleStart, c.freqHz,
+                     isoTime(c.timeNs + wallOffsetNs_).c_str());
+    }
+    std::fprintf(f, "\n  ],\n  \"annotations\": []\n}\n");
+    std::fclose(f);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Doorbell.hpp"
+#include "IQRing.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// SigMF recorder fed from the RX thread (writeSetting("record", ...)).
+//
+// push() copies into a lock-free queue (IQRing, a few seconds deep) and
+// never blocks: when the writer thread falls behind, or while a recording
+// is starting or stopping, the samples are dropped and counted, and the
+// next ones start a new SigMF capture segment so the gap is visible. The
+// writer runs at low CPU and I/O priority and writes 1 MiB aligned blocks,
+// optionally with O_DIRECT so hours of IQ do not churn the page cache.
+//
+// <base>.sigmf-data is written as the recording runs; <base>.sigmf-meta
+// when it stops.
+class IQRecorder
+{
+public:
+    struct Format
+    {
+        std::string datatype;  // SigMF, e.g. "cf32_le", "ri32_le"
+        size_t sampleBytes;    // all channels of one sample
+        unsigned channels;
+        unsigned rate;
+        std::string description;
+    };
+
+    ~IQRecorder();
+
+    // Any thread. Stops a recording already running. False (logged) when
+    // the data file cannot be created.
+    bool start(const std::string &base, const Format &fmt, bool direct, long long freqHz);
+    void stop();
+
+    bool active() const { return active_.load(std::memory_order_relaxed); }
+    std::string path() const;
+    uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // RX thread: n samples at `rate`, the first captured at monotonic
+    // timeNs with the radio tuned to freqHz. Other rates are dropped.
+    void push(const void *data, size_t n, unsigned rate, long long timeNs, long long freqHz);
+
+private:
+    struct Capture
+    {
+        uint64_t sampleStart;
+        long long freqHz;
+        long long timeNs; // monotonic
+    };
+
+    void writerMain();
+    bool flush(size_t bytes);
+    void writeMeta();
+
+    // start/stop vs push: push only ever try_locks
+    mutable std::mutex mutex_;
+    std::atomic<bool> active_{false};
+    bool gap_ = false;
+    long long lastFreqHz_ = 0;
+
+    std::string base_;
+    Format fmt_;
+    int fd_ = -1;
+    bool direct_ = false;
+    long long wallOffsetNs_ = 0; // CLOCK_REALTIME - CLOCK_MONOTONIC at start
+    std::vector<Capture> captures_; // reserved at start; RX thread appends
+
+    IQRing queue_;
+    IQRing::Reader queueReader_; // writer thread
+    std::thread writer_;
+    std::atomic<bool> run_{false};
+    Doorbell stopBell_;
+    uint8_t *block_ = nullptr; // aligned for O_DIRECT
+    size_t blockFill_ = 0;
+    bool failed_ = false;
+
+    std::atomic<uint64_t> samples_{0}; // pushed into the queue
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> missed_{0};  // while push could not take the lock
+};
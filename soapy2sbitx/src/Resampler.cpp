@@ -0,0 +1,145 @@
+#include "Resampler.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+static constexpr unsigned kMaxInterp = 625;
+
+RationalResampler::RationalResampler(unsigned interp, unsigned decim, unsigned tapsPerPhase)
+{
+    const unsigned g = std::gcd(interp, decim);
+    l_ = interp / g;
+    m_ = decim / g;
+
+    const size_t k = std::max(4u, tapsPerPhase);
+    len_ = (k + sbitx::kSimdWidth - 1) / sbitx::kSimdWidth * sbitx::kSimdWidth;
+
+    // Prototype at the interpolated rate L*fin; cutoff a little inside the
+    // lower Nyquist so the transition band does not alias back in.
+    const size_t n = (size_t)l_ * k;
+    const double fc = 0.45 / (double)std::max(l_, m_);
+    const double beta = 8.0;
+    const double c = (double)(n - 1) / 2.0;
+    std::vector<double> h(n);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const double x = (double)i - c;
+        const double r = c > 0.0 ? x / c : 0.0;
+        const double w = sbitx::besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / sbitx::besselI0(beta);
+        const double s = (x == 0.0) ? 2.0 * fc : std::sin(2.0 * M_PI * fc * x) / (M_PI * x);
+        h[i] = s * w;
+        sum += h[i];
+    }
+
+    // Each phase gets unity DC gain (overall gain L undoes the zero stuffing).
+    coef_.assign((size_t)l_ * len_, 0.0f);
+    for (unsigned p = 0; p < l_; p++)
+        for (size_t j = 0; j < k; j++)
+            coef_[p * len_ + (len_ - 1 - j)] = (float)(h[p + j * l_] * (double)l_ / sum);
+
+    re_.assign(2 * len_, 0.0f);
+    im_.assign(2 * len_, 0.0f);
+}
+
+size_t RationalResampler::process(const std::complex<float> *in, size_t n, std::complex<float> *out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        re_[pos_] = re_[pos_ + len_] = in[i].real();
+        im_[pos_] = im_[pos_ + len_] = in[i].imag();
+        const size_t w = pos_ + 1;
+        pos_ = (pos_ + 1 == len_) ? 0 : pos_ + 1;
+
+        // Outputs whose interpolated-rate position falls on this input.
+        while (phase_ < l_)
+        {
+            float re, im;
+            sbitx::dot2(&re_[w], &im_[w], &coef_[(size_t)phase_ * len_], len_, re, im);
+            out[o++] = std::complex<float>(re, im);
+            phase_ += m_;
+        }
+        phase_ -= l_;
+    }
+    return o;
+}
+
+void RationalResampler::reset()
+{
+    std::fill(re_.begin(), re_.end(), 0.0f);
+    std::fill(im_.begin(), im_.end(), 0.0f);
+    pos_ = 0;
+    phase_ = 0;
+}
+
+bool RateChain::supported(unsigned inFs, unsigned outFs)
+{
+    if (!inFs || !outFs) return false;
+    const unsigned g = std::gcd(inFs, outFs);
+    return outFs / g <= kMaxInterp;
+}
+
+RateChain::RateChain(unsigned inFs, unsigned outFs)
+    : inFs_(inFs), outFs_(outFs)
+{
+    // Halve while it is exact, or while the rational stage would still
+    // have at least 1.5x headroom; the halfband transition band then sits
+    // outside the final passband.
+    unsigned cur = inFs;
+    while (cur % 2 == 0 && (cur / 2 == outFs || cur / 2 >= outFs + outFs / 2))
+    {
+        halfbands_.emplace_back();
+        cur /= 2;
+    }
+    if (cur != outFs)
+        rational_.reset(new RationalResampler(outFs, cur));
+}
+
+size_t RateChain::maxOutput(size_t n) const
+{
+    for (size_t i = 0; i < halfbands_.size(); i++) n = n / 2 + 1;
+    return rational_ ? rational_->maxOutput(n) : n;
+}
+
+void RateChain::reset()
+{
+    for (auto &hb : halfbands_) hb.reset();
+    if (rational_) rational_->reset();
+}
+
+void RateChain::syncPhase(const RateChain &o)
+{
+    for (size_t i = 0; i < halfbands_.size() && i < o.halfbands_.size(); i++)
+        halfbands_[i].syncPhase(o.halfbands_[i]);
+    if (rational_ && o.rational_) rational_->syncPhase(*o.rational_);
+}
+
+size_t RateChain::process(const std::complex<float> *in, size_t n, std::complex<float> *out)
+{
+    if (passthrough())
+    {
+        std::copy(in, in + n, out);
+        return n;
+    }
+
+    const std::complex<float> *src = in;
+    const size_t stages = halfbands_.size() + (rational_ ? 1 : 0);
+    size_t stage = 0;
+    for (auto &hb : halfbands_)
+    {
+        std::complex<float> *dst = out;
+        if (++stage < stages)
+        {
+            auto &buf = scratch_[stage & 1];
+            if (buf.size() < n / 2 + 1) buf.resize(n / 2 + 1);
+            dst = buf.data();
+        }
+        n = hb.decimate(src, n, dst);
+        src = dst;
+    }
+    if (rational_) n = rational_->process(src, n, out);
+    return n;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "HalfbandDecimator.hpp"
+
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Polyphase L/M resampler for complex baseband.
+//
+// The prototype is a Kaiser-windowed lowpass at the narrower of the two
+// Nyquist rates, split into L phases of `tapsPerPhase` taps each. Every
+// output is one SIMD dot product on the phase that lands on it; the
+// zero-stuffed inputs are never touched.
+class RationalResampler
+{
+public:
+    static constexpr unsigned kDefaultTapsPerPhase = 32;
+
+    RationalResampler(unsigned interp, unsigned decim,
+                      unsigned tapsPerPhase = kDefaultTapsPerPhase);
+
+    unsigned interp() const { return l_; }
+    unsigned decim() const { return m_; }
+
+    // Upper bound on outputs for n inputs.
+    size_t maxOutput(size_t n) const { return (n * l_) / m_ + 2; }
+
+    size_t process(const std::complex<float> *in, size_t n, std::complex<float> *out);
+
+    // Same output positions as `o` from here on (same L/M).
+    void syncPhase(const RationalResampler &o) { phase_ = o.phase_; }
+    void reset();
+
+private:
+    unsigned l_ = 1, m_ = 1;
+    size_t len_ = 0;              // taps per phase, SIMD padded
+    std::vector<float> coef_;     // l_ * len_, each phase oldest first
+    std::vector<float> re_, im_;  // 2 * len_ mirrored history
+    size_t pos_ = 0;
+    unsigned phase_ = 0;
+};
+
+// Everything between the 48 kHz decimator output and the ring: halfband
+// stages for the power-of-two part of the ratio, then a rational stage for
+// whatever is left (e.g. 48k -> 24k -> 12k -> 8k is two halfbands and 2/3).
+class RateChain
+{
+public:
+    RateChain(unsigned inFs, unsigned outFs);
+
+    // Reduced L/M must stay small enough for a sane prototype.
+    static bool supported(unsigned inFs, unsigned outFs);
+
+    unsigned inFs() const { return inFs_; }
+    unsigned outFs() const { return outFs_; }
+    bool passthrough() const { return halfbands_.empty() && !rational_; }
+
+    size_t maxOutput(size_t n) const;
+
+    // Returns outputs written. Scratch grows on the first large call only.
+    size_t process(const std::complex<float> *in, size_t n, std::complex<float> *out);
+
+    // Clears all filter history. Never allocates.
+    void reset();
+
+    // Make a reset chain for the same rates emit exactly as many outputs
+    // per call as `o`, so two channels stay sample aligned.
+    void syncPhase(const RateChain &o);
+
+private:
+    unsigned inFs_, outFs_;
+    std::vector<HalfbandDecimator> halfbands_;
+    std::unique_ptr<RationalResampler> rational_;
+    std::vector<std::complex<float>> scratch_[2];
+};
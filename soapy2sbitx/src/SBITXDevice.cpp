@@ -1,4 +1,5 @@
 #include "SBITXDevice.hpp"
+#include "sbitx_ctrl.h"
 
 #include <SoapySDR/Logger.hpp>
 #include <SoapySDR/Formats.hpp>
@@ -8,39 +9,57 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
-#include <sstream>
 #include <thread>
+#include <cerrno>
 #include <climits>
 
-#ifdef __linux__
-#include <pthread.h>
-#include <sched.h>
-#include <netdb.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#endif
+// Offered RX rates. Anything RateChain::supported() accepts also works.
+static const std::vector<double> kRxRates = {
+    8000.0, 12000.0, 16000.0, 24000.0, 48000.0, 50000.0, 96000.0, 250000.0,
+};
+static const unsigned int kMaxRxFs = 250000;
 
-static inline float dbToLin(double db)
-{
-    return std::pow(10.0, db / 20.0);
-}
-static inline int32_t float_to_s32(float x)
+// "BB" fine tuning stays inside the codec's passband around the IF.
+static const double kMaxBbHz = 20000.0;
+
+// readStream flag on the first sample of the period an LO write landed in
+static const int kFlagLoChanged = SOAPY_SDR_USER_FLAG0;
+
+// Direct access: the RX ring is handed out as blocks of this many samples
+// (divides the power-of-two ring), TX gets this many staging buffers.
+static const size_t kDirectBlock = 1024;
+static const size_t kTxStageBuffers = 4;
+
+// A TX underrun more than this long after the previous period is the gap
+// between bursts, not a client falling behind (matches the PTT watchdog).
+static const long long kTxBurstGapNs = 250000000LL;
+
+static long long monotonicNs()
 {
-    x = std::max(-1.0f, std::min(0.999999f, x));
-    const float scale = 2147483647.0f;
-    return (int32_t)std::lrintf(x * scale);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-static inline float s32_to_float(int32_t x)
+static inline float dbToLin(double db)
 {
-    return (float)x / 2147483647.0f;
+    return std::pow(10.0, db / 20.0);
 }
 
 SBITXDevice::SBITXDevice(const SoapySDR::Kwargs &args)
 {
     alsaDev_ = args.count("alsa") ? args.at("alsa") : "hw:0,0";
+    // TX goes to the same codec, or nowhere when RX is a file or synth
+    const bool simulated = alsaDev_.rfind("file:", 0) == 0 || alsaDev_.rfind("synth", 0) == 0;
+    txDev_ = args.count("tx") ? args.at("tx") : simulated ? "null" : alsaDev_;
 
     fs_ = 48000;
+    if (args.count("rate"))
+    {
+        const unsigned int r = (unsigned int)std::stoul(args.at("rate"));
+        if (r > kMaxRxFs || !RateChain::supported(fs_, r))
+            throw std::runtime_error("SBITX: unsupported rate=" + args.at("rate"));
+        rxOutFs_.store(r);
+    }
     capFs_ = args.count("capFs") ? (unsigned int)std::stoul(args.at("capFs")) : 96000;
     pbFs_  = args.count("pbFs")  ? (unsigned int)std::stoul(args.at("pbFs"))  : 96000;
 
@@ -48,15 +67,44 @@ SBITXDevice::SBITXDevice(const SoapySDR::Kwargs &args)
     iqSwap_ = args.count("iq_swap") ? (std::stoi(args.at("iq_swap")) != 0) : false;
 
     iqInv_  = args.count("iq_inv") ? (std::stoi(args.at("iq_inv")) != 0) : false;
-    periodFrames_ = args.count("period") ? (snd_pcm_uframes_t)std::stoul(args.at("period")) : 1000;
-    bufferFrames_ = args.count("buffer") ? (snd_pcm_uframes_t)std::stoul(args.at("buffer")) : 4000;
+    periodFrames_ = args.count("period") ? (size_t)std::stoul(args.at("period")) : 1000;
+    bufferFrames_ = args.count("buffer") ? (size_t)std::stoul(args.at("buffer")) : 4000;
+
+    const unsigned decTaps = args.count("dec_taps") ? (unsigned)std::stoul(args.at("dec_taps"))
+                                                    : HalfbandDecimator::kDefaultTaps;
+
+    if (args.count("access"))
+    {
+        const std::string a = args.at("access");
+        if (a == "mmap") mmapRequested_ = true;
+        else if (a != "rw") throw std::runtime_error("SBITX: access must be rw or mmap");
+    }
 
     rt_ = args.count("rt") ? (std::stoi(args.at("rt")) != 0) : false;
     rtPrio_ = args.count("rt_prio") ? std::stoi(args.at("rt_prio")) : 70;
+    if (args.count("cpu") && !sbitx::parseCpuList(args.at("cpu"), cpus_))
+        throw std::runtime_error("SBITX: cpu must be a core list like 3, 2-3 or 1;3");
+    if (args.count("overflow"))
+    {
+        const std::string o = args.at("overflow");
+        if (o == "drop_oldest") overflow_ = OVERFLOW_DROP_OLDEST;
+        else if (o == "drop_newest") overflow_ = OVERFLOW_DROP_NEWEST;
+        else if (o == "block") overflow_ = OVERFLOW_BLOCK;
+        else throw std::runtime_error("SBITX: overflow must be drop_oldest, drop_newest or block");
+    }
+
+    // tune_window=NNN: RF moves within NNN Hz of the LO's centre only
+    // move the IF NCOs ("BB"); 0 retunes the LO every time
+    tuneWindowHz_ = args.count("tune_window") ? std::stoll(args.at("tune_window")) : 0;
+    if (tuneWindowHz_ < 0 || tuneWindowHz_ > (long long)kMaxBbHz)
+        throw std::runtime_error("SBITX: tune_window must be 0 to " + std::to_string((long long)kMaxBbHz) + " Hz");
+
+    pttLeadNs_ = (args.count("ptt_lead") ? std::stoll(args.at("ptt_lead")) : 20) * 1000000LL;
 
     // ctrl can be:
-    //   ctrl=127.0.0.1:9999   (default)
-    //   ctrl=none             (disable)
+    //   ctrl=127.0.0.1:9999          (default)
+    //   ctrl=unix:/run/sbitx.sock    (local socket, binary frames, shm state)
+    //   ctrl=none                    (disable)
     if (args.count("ctrl"))
     {
         const std::string c = args.at("ctrl");
@@ -64,6 +112,12 @@ SBITXDevice::SBITXDevice(const SoapySDR::Kwargs &args)
         {
             ctrlEnabled_ = false;
         }
+        else if (c.rfind("unix:", 0) == 0)
+        {
+            ctrlUnix_ = c.substr(5);
+            if (ctrlUnix_.empty()) ctrlUnix_ = SBITX_UNIX_PATH;
+            ctrlEnabled_ = true;
+        }
         else
         {
             auto pos = c.find(':');
@@ -76,21 +130,56 @@ SBITXDevice::SBITXDevice(const SoapySDR::Kwargs &args)
         }
     }
 
-    rbSize_ = fs_ * 2; // 2 seconds ring buffer @48k
-    rb_.assign(rbSize_, std::complex<float>(0, 0));
+    // Current and future pages: also covers what setupStream allocates
+    if (rt_) memLocked_ = sbitx::lockMemory();
+
+    const ThreadProfile ctrlProfile{cpus_, 0};
+    if (ctrlEnabled_ && !ctrlUnix_.empty())
+        ctrl_.reset(new CtrlClient(ctrlUnix_, ctrlProfile));
+    else if (ctrlEnabled_)
+        ctrl_.reset(new CtrlClient(ctrlHost_, ctrlPort_, ctrlProfile));
+
+    const std::string ctrlDesc = !ctrlUnix_.empty() ? "unix:" + ctrlUnix_
+                                                    : ctrlHost_ + ":" + std::to_string(ctrlPort_);
+
+    rxChain_ = RxChain(capFs_, fs_, ifHz_, decTaps);
+    rxChain_.setIqFix(iqInv_, iqSwap_);
+    txChain_ = TxChain(pbFs_, ifHz_);
+
+    // sub_bins=NN: channelizer bins for sub= streams, fs_/NN apart
+    const unsigned subBins = args.count("sub_bins") ? (unsigned)std::stoul(args.at("sub_bins")) : 16;
+    if (!PolyphaseChannelizer::validBins(subBins))
+        throw std::runtime_error("SBITX: sub_bins must be a power of two from 4 to 256");
+    subs_.configure(subBins, fs_, periodFrames_ / 2 + 1);
+
+    rb_.reset(fs_ * 2, rxFormatSize(RX_CF32)); // ~2 seconds ring buffer @48k (rounded up to a power of two)
 
     SoapySDR::logf(SOAPY_SDR_INFO,
-        "SBITX: alsa=%s fs=%u capFs=%u pbFs=%u if=%.1f iq_swap=%d iq_inv=%d period=%lu buffer=%lu rt=%d ctrl=%s:%d (%s)",
-        alsaDev_.c_str(), fs_, capFs_, pbFs_, ifHz_, (int)iqSwap_, (int)iqInv_,
-        (unsigned long)periodFrames_, (unsigned long)bufferFrames_, (int)rt_,
-        ctrlHost_.c_str(), ctrlPort_, ctrlEnabled_ ? "on" : "off");
+        "SBITX: alsa=%s tx=%s access=%s fs=%u rate=%u capFs=%u pbFs=%u if=%.1f iq_swap=%d iq_inv=%d dec_taps=%u period=%lu buffer=%lu rt=%d cpu=%s mlock=%d ctrl=%s (%s)",
+        alsaDev_.c_str(), txDev_.c_str(), mmapRequested_ ? "mmap" : "rw", fs_, rxOutFs_.load(), capFs_, pbFs_, ifHz_, (int)iqSwap_, (int)iqInv_, rxChain_.decTaps(),
+        (unsigned long)periodFrames_, (unsigned long)bufferFrames_, (int)rt_, sbitx::cpuListName(cpus_).c_str(), (int)memLocked_,
+        ctrlDesc.c_str(), ctrlEnabled_ ? "on" : "off");
+
+    // serve=0.0.0.0:1234 serve_fmt=cu8|cs8|cs16|cf32: last, the server
+    // opens its stream through this device once a client connects.
+    if (args.count("serve"))
+    {
+        IQServer::Format fmt = IQServer::FMT_CU8;
+        if (args.count("serve_fmt") && !IQServer::parseFormat(args.at("serve_fmt"), fmt))
+            throw std::runtime_error("SBITX: serve_fmt must be cu8, cs8, cs16 or cf32");
+        serveAddr_ = args.at("serve");
+        server_.reset(new IQServer(*this, serveAddr_, fmt));
+    }
 }
 
 SBITXDevice::~SBITXDevice()
 {
+    server_.reset(); // closes its RX stream
+    stopTxThread();
     stopRxThread();
-    closeAlsaCapture();
-    closeAlsaPlayback();
+    recorder_.stop();
+    capture_.reset();
+    playback_.reset();
 }
 
 SoapySDR::Kwargs SBITXDevice::getHardwareInfo() const
@@ -98,29 +187,41 @@ SoapySDR::Kwargs SBITXDevice::getHardwareInfo() const
     SoapySDR::Kwargs info;
     info["origin"] = "sbitx";
     info["alsa_capture"] = alsaDev_;
-    info["alsa_playback"] = alsaDev_;
+    info["alsa_playback"] = txDev_;
+    info["alsa_access"] = mmapRequested_ ? "mmap" : "rw";
     info["fs"] = std::to_string(fs_);
+    info["rate"] = std::to_string(rxOutFs_.load());
     info["cap_fs"] = std::to_string(capFs_);
     info["pb_fs"] = std::to_string(pbFs_);
     info["if_hz"] = std::to_string(ifHz_);
+    info["dec_taps"] = std::to_string(rxChain_.decTaps());
+    info["cpu"] = sbitx::cpuListName(cpus_);
+    info["mlock"] = memLocked_ ? "1" : "0";
+    info["tune_window"] = std::to_string(tuneWindowHz_);
+    info["sub_bins"] = std::to_string(subs_.bins());
+    info["sub_rate"] = std::to_string(subs_.rate());
     info["ctrl_host"] = ctrlHost_;
     info["ctrl_port"] = std::to_string(ctrlPort_);
+    if (!ctrlUnix_.empty()) info["ctrl_unix"] = ctrlUnix_;
+    if (server_) info["serve"] = serveAddr_;
     return info;
 }
 
-std::vector<double> SBITXDevice::listSampleRates(const int, const size_t) const
+std::vector<double> SBITXDevice::listSampleRates(const int direction, const size_t) const
 {
-    return { 48000.0 };
+    if (direction == SOAPY_SDR_TX) return { (double)fs_ };
+    return kRxRates;
 }
 std::vector<std::string> SBITXDevice::listFrequencies(const int, const size_t) const
 {
-    // piHPSDR expects "RF" to exist
-    return {"RF"};
+    // piHPSDR expects "RF" to exist. "BB" is the IF NCOs' fine tuning.
+    return {"RF", "BB"};
 }
 
 SoapySDR::RangeList SBITXDevice::getFrequencyRange(const int, const size_t, const std::string &name) const
 {
     SoapySDR::RangeList r;
+    if (name == "BB") r.push_back(SoapySDR::Range(-kMaxBbHz, kMaxBbHz));
     if (name != "RF") return r;
 
     // Be generous so piHPSDR is happy (HF through VHF etc).
@@ -191,41 +292,80 @@ std::string SBITXDevice::getAntenna(const int, const size_t) const
     return "ANT";
 }
 
-void SBITXDevice::setSampleRate(const int, const size_t, const double rate)
+void SBITXDevice::setSampleRate(const int direction, const size_t, const double rate)
 {
-    if (std::llround(rate) != 48000)
-        throw std::runtime_error("SBITX: only 48000 sps supported");
+    const long long r = std::llround(rate);
+    if (direction == SOAPY_SDR_TX)
+    {
+        if (r != (long long)fs_)
+            throw std::runtime_error("SBITX: TX only supports 48000 sps");
+        return;
+    }
+
+    if (r <= 0 || r > kMaxRxFs || !RateChain::supported(fs_, (unsigned int)r))
+        throw std::runtime_error("SBITX: unsupported RX sample rate " + std::to_string(r));
+
+    // Picked up by the RX thread at the next period.
+    rxOutFs_.store((unsigned int)r);
 }
 
-double SBITXDevice::getSampleRate(const int, const size_t) const
+double SBITXDevice::getSampleRate(const int direction, const size_t) const
 {
-    return 48000.0;
+    if (direction == SOAPY_SDR_TX) return (double)fs_;
+    return (double)rxOutFs_.load();
 }
 
+// "RF" is the whole frequency. Within tune_window= of the LO's centre only
+// "BB" moves, so the synthesizer is not rewritten for every VFO step.
+// SoapySDR's unnamed setFrequency sets "RF", then "BB" to what RF left over,
+// which comes to the same thing.
 void SBITXDevice::setFrequency(const int, const size_t, const std::string &name,
                                const double frequency, const SoapySDR::Kwargs &)
 {
+    const long long f = (long long)std::llround(frequency);
+    if (name == "BB")
+    {
+        const long long bb = (long long)std::llround(std::clamp(frequency, -kMaxBbHz, kMaxBbHz));
+        bbHz_.store(bb);
+        tuneHz_.store(syncLoHz() + bb);
+        return;
+    }
     if (name != "RF") return;
 
-    tuneHz_.store((long long)std::llround(frequency));
+    tuneHz_.store(f);
+    const long long lo = syncLoHz();
+    if (tuneWindowHz_ > 0 && lo != 0 && std::llabs(f - lo) <= tuneWindowHz_)
+    {
+        bbHz_.store(f - lo); // picked up by the RX and TX threads
+        return;
+    }
+    loHz_.store(f);
+    bbHz_.store(0);
 
     // Hardware LO is offset by IF (like your Quisk bridge)
     const long long hw = (long long)std::llround(frequency - ifHz_);
 
+    // Queued; returns immediately. Link errors are logged by ctrl_.
     if (ctrlEnabled_)
-    {
-        if (!ctrlSetFreqHz(hw))
-        {
-            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX ctrlSetFreqHz(%lld) failed", hw);
-        }
-    }
+        (void)ctrlSetFreqHz(hw);
+}
+
+// The radio can be retuned behind our back (its own UI, another ctrl
+// client): take the LO centre from what sbitx_ctrl reports when it can.
+long long SBITXDevice::syncLoHz()
+{
+    long long hw = 0;
+    if (ctrlEnabled_ && ctrlGetFreqHz(hw)) loHz_.store((long long)std::llround((double)hw + ifHz_));
+    return loHz_.load();
 }
 
 double SBITXDevice::getFrequency(const int, const size_t, const std::string &name) const
 {
+    if (name == "BB") return (double)bbHz_.load();
     if (name != "RF") return 0.0;
 
-    // Prefer asking hardware if ctrl is enabled
+    // Prefer the state sbitx_ctrl pushes; fall back to the last value set
+    // when it is stale (daemon gone) or ctrl is disabled.
     if (ctrlEnabled_)
     {
         long long hw = 0;
@@ -235,464 +375,884 @@ double SBITXDevice::getFrequency(const int, const size_t, const std::string &nam
             return (double)hw + ifHz_;
         }
     }
-    return (double)tuneHz_.load();
+    return (double)loHz_.load();
 }
 
-std::vector<std::string> SBITXDevice::getStreamFormats(const int, const size_t) const
+std::vector<std::string> SBITXDevice::getStreamFormats(const int direction, const size_t) const
 {
-    return { SOAPY_SDR_CF32 };
+    if (direction == SOAPY_SDR_TX) return { SOAPY_SDR_CF32 };
+    return { SOAPY_SDR_CF32, SOAPY_SDR_CS32, SOAPY_SDR_CS16 };
 }
 
-std::string SBITXDevice::getNativeStreamFormat(const int, const size_t, double &fullScale) const
+std::string SBITXDevice::getNativeStreamFormat(const int direction, const size_t, double &fullScale) const
 {
-    fullScale = 1.0;
-    return SOAPY_SDR_CF32;
+    if (direction == SOAPY_SDR_TX)
+    {
+        fullScale = 1.0;
+        return SOAPY_SDR_CF32;
+    }
+    // The codec delivers S32_LE; CS32 comes out of the integer chain unscaled.
+    fullScale = 2147483648.0;
+    return SOAPY_SDR_CS32;
 }
 
 SoapySDR::Stream *SBITXDevice::setupStream(const int direction, const std::string &format,
                                            const std::vector<size_t> &channels,
-                                           const SoapySDR::Kwargs &)
+                                           const SoapySDR::Kwargs &args)
 {
-    if (format != SOAPY_SDR_CF32) throw std::runtime_error("SBITX: only CF32 supported");
-    if (!channels.empty() && channels.at(0) != 0) throw std::runtime_error("SBITX: only channel 0");
-
+    std::lock_guard<std::recursive_mutex> lock(streamMutex_);
     if (direction == SOAPY_SDR_RX)
     {
-        if (!openAlsaCapture()) throw std::runtime_error("SBITX: ALSA capture open failed");
+        RxFormat fmt;
+        if (format == SOAPY_SDR_CF32) fmt = RX_CF32;
+        else if (format == SOAPY_SDR_CS32) fmt = RX_CS32;
+        else if (format == SOAPY_SDR_CS16) fmt = RX_CS16;
+        else throw std::runtime_error("SBITX: RX supports CF32, CS32 and CS16");
+
+        // sub=<offset Hz>: one channelizer bin of channel 0, at subs_.rate()
+        if (args.count("sub"))
+        {
+            const double offset = std::stod(args.at("sub"));
+            if (fmt != RX_CF32) throw std::runtime_error("SBITX: sub= streams are CF32 only");
+            if (channels.size() > 1 || (!channels.empty() && channels[0] != 0))
+                throw std::runtime_error("SBITX: sub= streams are cut from channel 0 only");
+            if (std::fabs(offset) >= fs_ / 2.0)
+                throw std::runtime_error("SBITX: sub= offset must be within +/-" + std::to_string(fs_ / 2) + " Hz");
+
+            const int slot = subs_.open(offset);
+            if (slot < 0)
+                throw std::runtime_error("SBITX: all " + std::to_string(SubReceivers::kMaxSlots) + " sub= streams in use");
+            if (!openCapture())
+            {
+                subs_.close(slot);
+                throw std::runtime_error("SBITX: capture open failed (" + alsaDev_ + ")");
+            }
+
+            // First RX stream: the main ring still needs a layout
+            if (rxUsers_.load() == 0) relayoutRx(RX_CF32, 1);
+
+            auto *s = new SBITXStream{SOAPY_SDR_RX, {0}};
+            s->sub = slot;
+            if (args.count("min_block"))
+                s->minBlock = (size_t)std::stoul(args.at("min_block"));
+            rxUsers_.fetch_add(1);
+            SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: sub stream %+.1f Hz: bin %u of %u, %u sps",
+                           offset, subs_.bin(slot), subs_.bins(), subs_.rate());
+            return (SoapySDR::Stream*)s;
+        }
+
+        // Channel 0 is the IF IQ, channel 1 the mic, in any order.
+        std::vector<size_t> chans = channels.empty() ? std::vector<size_t>{0} : channels;
+        bool mic = false;
+        for (size_t i = 0; i < chans.size(); i++)
+        {
+            if (chans[i] > 1 || std::count(chans.begin(), chans.end(), chans[i]) > 1)
+                throw std::runtime_error("SBITX: RX channels are 0 (IF) and 1 (mic)");
+            mic = mic || chans[i] == 1;
+        }
+
+        // follow=1: CF32 channel 0 out of whatever layout the other streams
+        // pick (serve= opens its stream this way)
+        const bool follow = args.count("follow") && args.at("follow") != "0";
+        if (follow && (fmt != RX_CF32 || chans.size() != 1 || mic))
+            throw std::runtime_error("SBITX: follow= streams are CF32 channel 0 only");
+
+        // The RX thread produces one format and channel layout. The first
+        // plain stream picks them; follow= and sub= streams only take a
+        // default until then.
+        const unsigned want = mic ? 2 : 1;
+        const bool relayout = rxUsers_.load() == 0 ||
+                              (!follow && rxRingUsers_ == 0 && (fmt != rxFormat_ || want != rxChannels_));
+        if (!relayout && !follow && fmt != rxFormat_)
+            throw std::runtime_error("SBITX: RX streams must share one format");
+        if (!relayout && mic && rxChannels_ == 1)
+            throw std::runtime_error("SBITX: channel 1 needs the first RX stream to include it");
+
+        if (!openCapture()) throw std::runtime_error("SBITX: capture open failed (" + alsaDev_ + ")");
+        if (relayout) relayoutRx(fmt, want);
+        auto *s = new SBITXStream{SOAPY_SDR_RX, chans};
+        s->format = fmt;
+        s->follow = follow;
+        if (follow) rxFollowers_.push_back(s);
+        else rxRingUsers_++;
+        // min_block=N: readStream waits for N samples (capped at numElems)
+        // so clients get full blocks instead of whatever one period left.
+        if (args.count("min_block"))
+            s->minBlock = (size_t)std::stoul(args.at("min_block"));
         rxUsers_.fetch_add(1);
-        return (SoapySDR::Stream*)new SBITXStream{SOAPY_SDR_RX, 0};
+        return (SoapySDR::Stream*)s;
     }
     else if (direction == SOAPY_SDR_TX)
     {
-        if (!openAlsaPlayback()) throw std::runtime_error("SBITX: ALSA playback open failed");
+        if (!channels.empty() && (channels.size() > 1 || channels[0] != 0))
+            throw std::runtime_error("SBITX: TX has channel 0 only");
+        if (format != SOAPY_SDR_CF32) throw std::runtime_error("SBITX: TX only supports CF32");
+        if (!openPlayback()) throw std::runtime_error("SBITX: playback open failed (" + txDev_ + ")");
+        if (txStage_.empty())
+            txStage_.assign(kTxStageBuffers, std::vector<std::complex<float>>(std::max<size_t>(1, periodFrames_ / 2)));
+        if (txUsers_.load() == 0)
+        {
+            txRing_.reset(std::max<size_t>(4096, periodFrames_ * 2), sizeof(std::complex<float>));
+            txReader_ = txRing_.attach();
+            txMarkTail_.store(txMarkHead_.load());
+        }
+        auto *s = new SBITXStream{SOAPY_SDR_TX, {0}};
+        s->underrunsSeen = txUnderruns_.load();
+        s->lateSeen = txLateBursts_.load();
         txUsers_.fetch_add(1);
-        return (SoapySDR::Stream*)new SBITXStream{SOAPY_SDR_TX, 0};
+        return (SoapySDR::Stream*)s;
     }
 
     throw std::runtime_error("SBITX: invalid direction");
 }
 
+SoapySDR::ArgInfoList SBITXDevice::getStreamArgsInfo(const int direction, const size_t) const
+{
+    SoapySDR::ArgInfoList list;
+    if (direction != SOAPY_SDR_RX) return list;
+
+    SoapySDR::ArgInfo minBlock;
+    minBlock.key = "min_block";
+    minBlock.value = "0";
+    minBlock.name = "Minimum block";
+    minBlock.description = "readStream waits until this many samples are ready (0 = return any data)";
+    minBlock.units = "samples";
+    minBlock.type = SoapySDR::ArgInfo::INT;
+    list.push_back(minBlock);
+
+    SoapySDR::ArgInfo sub;
+    sub.key = "sub";
+    sub.value = "";
+    sub.name = "Sub-receiver offset";
+    sub.description = "Open a narrow CF32 stream centred this far from the tuned frequency, at 2*fs/sub_bins";
+    sub.units = "Hz";
+    sub.type = SoapySDR::ArgInfo::FLOAT;
+    list.push_back(sub);
+
+    SoapySDR::ArgInfo follow;
+    follow.key = "follow";
+    follow.value = "0";
+    follow.name = "Follow";
+    follow.description = "CF32 channel 0 stream that converts from whatever format and channels the other RX streams use";
+    follow.type = SoapySDR::ArgInfo::BOOL;
+    list.push_back(follow);
+    return list;
+}
+
+size_t SBITXDevice::getStreamMTU(SoapySDR::Stream *stream) const
+{
+    // A sub stream gets one frame per bins/2 samples at fs_
+    const auto *s = reinterpret_cast<const SBITXStream*>(stream);
+    if (s && s->sub >= 0) return std::max<size_t>(1, periodFrames_ / subs_.bins());
+
+    // One ALSA period after decimation by 2 and the output rate change
+    const size_t n = periodFrames_ / 2;
+    return std::max<size_t>(1, (size_t)((unsigned long long)n * rxOutFs_.load() / fs_));
+}
+
 void SBITXDevice::closeStream(SoapySDR::Stream *stream)
 {
     auto *s = reinterpret_cast<SBITXStream*>(stream);
     if (!s) return;
+    std::lock_guard<std::recursive_mutex> lock(streamMutex_);
 
     if (s->direction == SOAPY_SDR_RX)
     {
+        const double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - s->t0).count();
+        if (s->reads && secs > 0.0)
+            SoapySDR::logf(SOAPY_SDR_INFO,
+                "SBITX: RX stream %.1fs: %.1f reads/s, %.1f wakeups/s, avg block %.1f samples",
+                secs, s->reads / secs, s->wakeups / secs, (double)s->samples / (double)s->reads);
+
+        deactivateStream(stream, 0, 0);
+        if (s->sub >= 0) subs_.close(s->sub);
+        else if (s->follow) rxFollowers_.erase(std::find(rxFollowers_.begin(), rxFollowers_.end(), s));
+        else rxRingUsers_--;
         int after = rxUsers_.fetch_sub(1) - 1;
         if (after <= 0)
         {
             stopRxThread();
-            closeAlsaCapture();
+            capture_.reset();
+            if (rb_.dropped())
+                SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: RX ring dropped %llu samples (reader too slow)",
+                               (unsigned long long)rb_.dropped());
+            if (rxXruns_.load())
+                SoapySDR::logf(SOAPY_SDR_INFO, "SBITX: RX capture overran %llu times (RX thread too slow)",
+                               rxXruns_.load());
         }
     }
     else if (s->direction == SOAPY_SDR_TX)
     {
+        deactivateStream(stream, 0, 0);
         int after = txUsers_.fetch_sub(1) - 1;
         if (after <= 0)
         {
-            closeAlsaPlayback();
+            stopTxThread();
+            playback_.reset();
         }
     }
 
     delete s;
 }
 
+// Each active RX stream has its own reader on rb_ and sees every sample
+// from activation on; the RX thread runs while any of them is active.
 int SBITXDevice::activateStream(SoapySDR::Stream *stream, const int, const long long, const size_t)
 {
+    std::lock_guard<std::recursive_mutex> lock(streamMutex_);
     auto *s = reinterpret_cast<SBITXStream*>(stream);
     if (s && s->direction == SOAPY_SDR_RX)
-        startRxThread();
+    {
+        if (s->active) return 0;
+        s->reader = s->sub >= 0 ? subs_.start(s->sub) : rb_.attach();
+        if (!s->reader.valid()) return SOAPY_SDR_STREAM_ERROR; // kMaxReaders active already
+        s->droppedSeen = 0;
+        s->xrunsSeen = rxXruns_.load();
+        s->loMarkSeen = rxLoMark_.load();
+        s->active = true;
+        if (usesMic(s)) rxMicActive_.fetch_add(1);
+        if (rxActive_.fetch_add(1) == 0) startRxThread();
+    }
+    else if (s && s->direction == SOAPY_SDR_TX)
+    {
+        if (!s->active)
+        {
+            s->active = true;
+            txActiveStreams_.fetch_add(1);
+        }
+        startTxThread();
+    }
     return 0;
 }
 
 int SBITXDevice::deactivateStream(SoapySDR::Stream *stream, const int, const long long)
 {
+    std::lock_guard<std::recursive_mutex> lock(streamMutex_);
     auto *s = reinterpret_cast<SBITXStream*>(stream);
     if (s && s->direction == SOAPY_SDR_RX)
-        stopRxThread();
+    {
+        if (!s->active) return 0;
+        s->active = false;
+        if (usesMic(s)) rxMicActive_.fetch_sub(1);
+        if (rxActive_.fetch_sub(1) == 1) stopRxThread();
+        if (s->sub >= 0) subs_.stop(s->sub, s->reader);
+        else rb_.detach(s->reader);
+        if (overflow_ == OVERFLOW_BLOCK) rbSpaceBell_.ring(); // no longer the slowest reader
+    }
+    else if (s && s->direction == SOAPY_SDR_TX)
+    {
+        // The TX thread is shared: it stops with the last active stream (or
+        // when none was ever activated and writeStream started it).
+        int left = txActiveStreams_.load();
+        if (s->active)
+        {
+            s->active = false;
+            left = txActiveStreams_.fetch_sub(1) - 1;
+        }
+        if (left <= 0) txShutdown();
+    }
     return 0;
 }
 
-int SBITXDevice::readStream(SoapySDR::Stream *, void * const *buffs, const size_t numElems,
+int SBITXDevice::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems,
                             int &flags, long long &timeNs, const long timeoutUs)
 {
     flags = 0;
     timeNs = 0;
 
-    auto *out = reinterpret_cast<std::complex<float>*>(buffs[0]);
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
 
-    const auto t0 = std::chrono::steady_clock::now();
-    while (true)
-    {
-        size_t got = rbRead(out, numElems);
-        if (got) return (int)got;
+    // relayoutRx() moves follow= readers to the new ring
+    std::unique_lock<std::mutex> layout(rxLayoutMutex_, std::defer_lock);
+    if (s->follow) layout.lock();
+    if (!s->active) return SOAPY_SDR_STREAM_ERROR;
 
-        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    const size_t want = std::max<size_t>(1, std::min(numElems, s->minBlock));
+    rbWait(s, want, timeoutUs);
 
-        auto dt = std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now() - t0).count();
-        if (dt > timeoutUs) return SOAPY_SDR_TIMEOUT;
-    }
-}
+    // Samples lost while we slept are reported before the ones after them.
+    if (rxOverflowed(s)) return SOAPY_SDR_OVERFLOW;
 
+    // On timeout hand back whatever partial block there is.
+    uint64_t idx = 0;
+    const size_t got = rbRead(s, buffs, rxLoChange(s, numElems, flags), &idx);
+    if (!got) return SOAPY_SDR_TIMEOUT;
 
+    // Sub-receiver rings have no clock of their own
+    if (s->sub < 0 && rxTimeAt(idx, timeNs)) flags |= SOAPY_SDR_HAS_TIME;
 
-bool SBITXDevice::openAlsaCapture()
-{
-    if (capHandle_) return true;
+    s->reads++;
+    s->samples += got;
+    return (int)got;
+}
 
-    int rc = snd_pcm_open(&capHandle_, alsaDev_.c_str(), SND_PCM_STREAM_CAPTURE, 0);
-    if (rc < 0)
-    {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_open CAP failed: %s", snd_strerror(rc));
-        capHandle_ = nullptr;
-        return false;
-    }
 
-    snd_pcm_hw_params_t *hw;
-    snd_pcm_hw_params_alloca(&hw);
-    snd_pcm_hw_params_any(capHandle_, hw);
-    snd_pcm_hw_params_set_access(capHandle_, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(capHandle_, hw, SND_PCM_FORMAT_S32_LE);
-    snd_pcm_hw_params_set_channels(capHandle_, hw, 2);
 
-    unsigned int rate = capFs_;
-    snd_pcm_hw_params_set_rate_near(capHandle_, hw, &rate, nullptr);
+AudioConfig SBITXDevice::audioConfig(unsigned rate) const
+{
+    AudioConfig cfg;
+    cfg.rate = rate;
+    cfg.mmap = mmapRequested_;
+    cfg.periodFrames = periodFrames_;
+    cfg.bufferFrames = bufferFrames_;
+    cfg.ifHz = ifHz_;
+    return cfg;
+}
 
-    snd_pcm_hw_params_set_period_size_near(capHandle_, hw, &periodFrames_, nullptr);
-    snd_pcm_hw_params_set_buffer_size_near(capHandle_, hw, &bufferFrames_);
+bool SBITXDevice::openCapture()
+{
+    if (capture_) return true;
+
+    AudioConfig cfg = audioConfig(capFs_);
+    capture_ = openCaptureSource(alsaDev_, cfg);
+    if (!capture_) return false;
+    periodFrames_ = cfg.periodFrames;
+    bufferFrames_ = cfg.bufferFrames;
+    // The RX thread is not running yet: size the sub-receiver scratch for
+    // the period ALSA actually gave us, not the one we asked for.
+    subs_.configure(subs_.bins(), fs_, periodFrames_ / 2 + 1);
+    return true;
+}
 
-    rc = snd_pcm_hw_params(capHandle_, hw);
-    if (rc < 0)
-    {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_hw_params CAP failed: %s", snd_strerror(rc));
-        snd_pcm_close(capHandle_);
-        capHandle_ = nullptr;
-        return false;
-    }
+bool SBITXDevice::openPlayback()
+{
+    if (playback_) return true;
 
-    snd_pcm_prepare(capHandle_);
+    AudioConfig cfg = audioConfig(pbFs_);
+    playback_ = openPlaybackSink(txDev_, cfg);
+    if (!playback_) return false;
+    periodFrames_ = cfg.periodFrames;
+    bufferFrames_ = cfg.bufferFrames;
     return true;
 }
 
-void SBITXDevice::closeAlsaCapture()
+// Everything the RX thread writes to, allocated and touched before it
+// starts (with no stream open it is not running): the ring is zeroed by
+// reset(), the capture buffer by openCapture(), the DSP buffers here.
+void SBITXDevice::prefaultRx()
 {
-    if (!capHandle_) return;
-    snd_pcm_drop(capHandle_);
-    snd_pcm_close(capHandle_);
-    capHandle_ = nullptr;
+    rxChain_.configure(rxFormat_, rxOutFs_.load(), periodFrames_, rxChannels_);
 }
 
-bool SBITXDevice::openAlsaPlayback()
+// New ring layout while no plain stream reads rb_: sub= streams do not use
+// it and follow= readers are moved over. The RX thread picks the layout up
+// when it starts, so a running one is restarted.
+void SBITXDevice::relayoutRx(RxFormat fmt, unsigned channels)
 {
-    if (pbHandle_) return true;
+    std::lock_guard<std::mutex> lock(rxLayoutMutex_);
+    const bool running = rxRun_.load();
+    stopRxThread();
 
-    int rc = snd_pcm_open(&pbHandle_, alsaDev_.c_str(), SND_PCM_STREAM_PLAYBACK, 0);
-    if (rc < 0)
+    if (!recordRaw_.load() && recorder_.active() && (fmt != rxFormat_ || channels != rxChannels_))
     {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_open PB failed: %s", snd_strerror(rc));
-        pbHandle_ = nullptr;
-        return false;
+        recorder_.stop();
+        SoapySDR::log(SOAPY_SDR_WARNING, "SBITX: RX format changed, recording stopped");
     }
 
-    snd_pcm_hw_params_t *hw;
-    snd_pcm_hw_params_alloca(&hw);
-    snd_pcm_hw_params_any(pbHandle_, hw);
-    snd_pcm_hw_params_set_access(pbHandle_, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(pbHandle_, hw, SND_PCM_FORMAT_S32_LE);
-    snd_pcm_hw_params_set_channels(pbHandle_, hw, 2);
-
-    unsigned int rate = pbFs_;
-    snd_pcm_hw_params_set_rate_near(pbHandle_, hw, &rate, nullptr);
-
-    snd_pcm_hw_params_set_period_size_near(pbHandle_, hw, &periodFrames_, nullptr);
-    snd_pcm_hw_params_set_buffer_size_near(pbHandle_, hw, &bufferFrames_);
-
-    rc = snd_pcm_hw_params(pbHandle_, hw);
-    if (rc < 0)
+    rxFormat_ = fmt;
+    rxChannels_ = channels;
+    rb_.reset(fs_ * 2, rxFormatSize(fmt) * channels);
+    rxLoMark_.store(0);
+    for (SBITXStream *f : rxFollowers_)
     {
-        SoapySDR::logf(SOAPY_SDR_ERROR, "snd_pcm_hw_params PB failed: %s", snd_strerror(rc));
-        snd_pcm_close(pbHandle_);
-        pbHandle_ = nullptr;
-        return false;
+        if (!f->active) continue;
+        f->reader = rb_.attach();
+        f->droppedSeen = 0;
+        f->loMarkSeen = 0;
     }
+    prefaultRx();
 
-    snd_pcm_prepare(pbHandle_);
-    return true;
-}
-
-void SBITXDevice::closeAlsaPlayback()
-{
-    if (!pbHandle_) return;
-    snd_pcm_drop(pbHandle_);
-    snd_pcm_close(pbHandle_);
-    pbHandle_ = nullptr;
+    if (running) startRxThread();
 }
 
 void SBITXDevice::startRxThread()
 {
     if (rxRun_.exchange(true)) return;
     rxThread_ = std::thread(&SBITXDevice::rxThreadMain, this);
-
-#ifdef __linux__
-    if (rt_)
-    {
-        sched_param sp{};
-        sp.sched_priority = rtPrio_;
-        pthread_setschedparam(rxThread_.native_handle(), SCHED_FIFO, &sp);
-    }
-#endif
 }
 
 void SBITXDevice::stopRxThread()
 {
     if (!rxRun_.exchange(false)) return;
+    rbSpaceBell_.ring();
     if (rxThread_.joinable()) rxThread_.join();
 }
 
-void SBITXDevice::rbWrite(const std::complex<float>* in, size_t n)
+size_t SBITXDevice::rxFormatSize(RxFormat fmt)
+{
+    // One complex sample: CF32 and CS32 are 2x4 bytes, CS16 2x2
+    return fmt == RX_CS16 ? 2 * sizeof(int16_t) : 2 * sizeof(int32_t);
+}
+
+// Channel 0 of n ring elements (elem bytes apart, in fmt) -> CF32
+static void ringToCF32(const uint8_t *in, size_t elem, RxFormat fmt, size_t n, float *out)
+{
+    for (size_t i = 0; i < n; i++, in += elem)
+    {
+        if (fmt == RX_CF32)
+        {
+            std::memcpy(out + 2 * i, in, 2 * sizeof(float));
+        }
+        else if (fmt == RX_CS32)
+        {
+            int32_t v[2];
+            std::memcpy(v, in, sizeof(v));
+            out[2 * i] = (float)v[0] * (1.0f / 2147483648.0f);
+            out[2 * i + 1] = (float)v[1] * (1.0f / 2147483648.0f);
+        }
+        else
+        {
+            int16_t v[2];
+            std::memcpy(v, in, sizeof(v));
+            out[2 * i] = (float)v[0] * (1.0f / 32768.0f);
+            out[2 * i + 1] = (float)v[1] * (1.0f / 32768.0f);
+        }
+    }
+}
+
+void SBITXDevice::rbWrite(const void *in, size_t n)
+{
+    // drop_oldest never blocks the RX thread; a lapped reader counts the drop.
+    if (overflow_ == OVERFLOW_DROP_NEWEST && rb_.freeSpace() < n)
+    {
+        rb_.reject(n);
+        return;
+    }
+    if (overflow_ == OVERFLOW_BLOCK)
+    {
+        // ALSA's buffer absorbs the stall; past that capture overruns.
+        while (rb_.freeSpace() < n && rxRun_.load())
+        {
+            rbSpaceBell_.waitFor([&] { return rb_.freeSpace() >= n || !rxRun_.load(); }, 50000);
+            pttWatchdog();
+        }
+        if (!rxRun_.load()) return;
+    }
+
+    rb_.write(in, n);
+    rbBell_.ring();
+}
+
+size_t SBITXDevice::rbRead(SBITXStream *s, void * const *buffs, size_t n, uint64_t *index)
 {
-    std::lock_guard<std::mutex> lock(rbMutex_);
-    for (size_t i = 0; i < n; i++)
+    size_t got = 0;
+    if (s->sub >= 0 || (rxChannels_ == 1 && s->format == rxFormat_))
+    {
+        got = s->reader.read(buffs[0], n, index);
+    }
+    else if (s->follow)
+    {
+        // Whole samples to scratch, then channel 0 out as CF32
+        const size_t elem = rb_.elemSize();
+        n = std::min(n, rb_.capacity());
+        if (s->scratch.size() < n * elem) s->scratch.resize(n * elem);
+        got = s->reader.read(s->scratch.data(), n, index);
+        ringToCF32(s->scratch.data(), elem, rxFormat_, got, static_cast<float*>(buffs[0]));
+    }
+    else
     {
-        rb_[rbHead_] = in[i];
-        rbHead_ = (rbHead_ + 1) % rbSize_;
-        if (rbHead_ == rbTail_) rbTail_ = (rbTail_ + 1) % rbSize_;
+        // Whole samples (every channel) to scratch, then each wanted
+        // channel out to its buffer.
+        const size_t elem = rb_.elemSize();
+        const size_t bytes = rxFormatSize(s->format);
+        n = std::min(n, rb_.capacity());
+        if (s->scratch.size() < n * elem) s->scratch.resize(n * elem);
+        got = s->reader.read(s->scratch.data(), n, index);
+        for (size_t c = 0; c < s->channels.size(); c++)
+        {
+            const uint8_t *in = s->scratch.data() + s->channels[c] * bytes;
+            uint8_t *out = static_cast<uint8_t*>(buffs[c]);
+            for (size_t i = 0; i < got; i++) std::memcpy(out + i * bytes, in + i * elem, bytes);
+        }
     }
+    if (overflow_ == OVERFLOW_BLOCK) rbSpaceBell_.ring();
+    return got;
+}
+
+// An LO change starts a read of its own: reads stop short of its first
+// sample, and the read that starts there carries kFlagLoChanged. Returns how
+// many of n samples this read may take.
+size_t SBITXDevice::rxLoChange(SBITXStream *s, size_t n, int &flags)
+{
+    const uint64_t mark = rxLoMark_.load(std::memory_order_acquire);
+    if (s->sub >= 0 || mark == s->loMarkSeen) return n;
+
+    const uint64_t pos = s->reader.readIndex();
+    if (pos + 1 < mark) return std::min<uint64_t>(n, mark - 1 - pos);
+    if (!s->reader.available()) return n; // flag it with the sample
+
+    flags |= kFlagLoChanged;
+    s->loMarkSeen = mark;
+    return n;
+}
+
+bool SBITXDevice::usesMic(const SBITXStream *s)
+{
+    return std::find(s->channels.begin(), s->channels.end(), 1) != s->channels.end();
+}
+
+// True once per batch of lost samples: ring drops (either policy) or
+// capture overruns since this stream last looked.
+bool SBITXDevice::rxOverflowed(SBITXStream *s)
+{
+    s->reader.catchUp();
+    const uint64_t dropped = s->reader.dropped();
+    const unsigned long long xruns = rxXruns_.load(std::memory_order_relaxed);
+    if (dropped == s->droppedSeen && xruns == s->xrunsSeen) return false;
+    s->droppedSeen = dropped;
+    s->xrunsSeen = xruns;
+    return true;
 }
 
-size_t SBITXDevice::rbRead(std::complex<float>* out, size_t n)
+// If TX was keyed but no TX samples arrive, unkey after a timeout.
+void SBITXDevice::pttWatchdog()
 {
-    std::lock_guard<std::mutex> lock(rbMutex_);
-    size_t avail = (rbHead_ + rbSize_ - rbTail_) % rbSize_;
-    size_t take = std::min(n, avail);
-    for (size_t i = 0; i < take; i++)
+    if (!txActive_.load(std::memory_order_relaxed)) return;
+
+    const long long lastNs = lastTxNs_.load(std::memory_order_relaxed);
+    // 250 ms without TX samples => assume client left MOX, unkey.
+    if (lastNs != 0 && monotonicNs() - lastNs > 250000000LL)
     {
-        out[i] = rb_[rbTail_];
-        rbTail_ = (rbTail_ + 1) % rbSize_;
+        (void)ctrlSetPTT(false);
+        txActive_.store(false, std::memory_order_relaxed);
     }
-    return take;
+}
+
+bool SBITXDevice::rxTimeAt(uint64_t index, long long &timeNs) const
+{
+    if (!rxClock_.timeAt(index, timeNs)) return false;
+    timeNs += timeOffsetNs_.load(std::memory_order_relaxed);
+    return true;
+}
+
+bool SBITXDevice::rbWait(SBITXStream *s, size_t want, long timeoutUs)
+{
+    return rbBell_.waitFor([&] { return s->reader.available() >= want; }, timeoutUs, &s->wakeups);
 }
 
 void SBITXDevice::rxThreadMain()
 {
     // Capture 96k stereo S32 from WM8731:
-    // Left = real IF (audio), Right = MIC (ignored here)
-    //
-    // Create complex IQ at 48k:
-    //  1) Mix down by e^{-j*ph} at IF
-    //  2) 2-tap boxcar lowpass and decimate-by-2 (reduces alias/images)
+    // Left = real IF (audio), Right = MIC (RX channel 1 when a stream wants it)
+    // rxChain_ turns each period into stream samples (DspChain.hpp).
     //
-    std::vector<int32_t> inFrames(periodFrames_ * 2);
-    std::vector<std::complex<float>> outIQ(periodFrames_ / 2);
+    sbitx::enterThread({cpus_, rt_ ? rtPrio_ : 0}, "sbitx-rx");
 
-    double ph = rxPhase_;
-    const double w = 2.0 * M_PI * (ifHz_ / (double)capFs_);
+    const RxFormat fmt = rxFormat_;
+    const unsigned channels = rxChannels_;
+
+    rxClock_.reset();
+    long long lastWakeNs = 0;
+    unsigned long long loApplied = ctrl_ ? ctrl_->freqApplied() : 0;
 
     while (rxRun_.load())
     {
-        // PTT watchdog: if TX was keyed but no TX samples arrive, unkey after a timeout.
-        if (txActive_.load(std::memory_order_relaxed))
+        pttWatchdog();
+
+        // Period source: the DMA area itself with access=mmap
+        const int32_t *cap = nullptr;
+        size_t capStride = 2;
+        size_t frames = 0;
+        const bool got = capture_->begin(periodFrames_, cap, capStride, frames);
+        if (const unsigned long long x = capture_->takeXruns())
+            rxXruns_.fetch_add(x, std::memory_order_relaxed);
+        if (!got) continue;
+
+        // Wakeup jitter: distance from one period after the previous wakeup
+        const long long wakeNs = monotonicNs();
+        if (lastWakeNs)
+            rxWakeJitterNs_.record(std::llabs(wakeNs - lastWakeNs - (long long)(frames * 1e9 / capFs_)));
+        lastWakeNs = wakeNs;
+
+        // Time of this period's first frame. Filter delay (well under 1 ms)
+        // is not taken out.
+        const long long capNs = rxClock_.capture(capture_->firstFrameNs(), frames, capFs_);
+
+        const bool recordRaw = recordRaw_.load(std::memory_order_relaxed);
+        const long long tuneHz = tuneHz_.load(std::memory_order_relaxed);
+        if (recordRaw && capStride == 2) recorder_.push(cap, frames, capFs_, capNs, tuneHz);
+
+        // setSampleRate only publishes the rate; the chain is rebuilt here so
+        // its filter state is never touched from another thread.
+        const unsigned int outFs = rxOutFs_.load(std::memory_order_relaxed);
+        if (!rxChain_.configured(fmt, outFs, channels))
+            rxChain_.configure(fmt, outFs, periodFrames_, channels);
+        rxChain_.setMic(rxMicActive_.load(std::memory_order_relaxed) > 0);
+        rxChain_.setShift((double)bbHz_.load(std::memory_order_relaxed));
+
+        const void *iq = nullptr;
+        const size_t o = rxChain_.process(cap, capStride, frames, iq);
+
+        // sub= streams: channel 0 at fs_, before the rate change
+        if (subs_.running())
         {
-            const auto nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count();
-            const auto lastNs = lastTxNs_.load(std::memory_order_relaxed);
-            // 250 ms without TX samples => assume client left MOX, unkey.
-            if (lastNs != 0 && (nowNs - lastNs) > 250000000LL)
-            {
-                (void)ctrlSetPTT(false);
-                txActive_.store(false, std::memory_order_relaxed);
-            }
+            size_t wn = 0;
+            const std::complex<float> *wide = rxChain_.wide(wn);
+            subs_.process(wide, wn);
+            rbBell_.ring();
         }
 
-        snd_pcm_sframes_t rd = snd_pcm_readi(capHandle_, inFrames.data(), periodFrames_);
-        if (rd < 0)
+        rxDspNs_.record(monotonicNs() - wakeNs);
+        capture_->end();
+
+        if (o)
         {
-            rd = snd_pcm_recover(capHandle_, (int)rd, 1);
-            if (rd < 0)
+            if (!recordRaw) recorder_.push(iq, o, outFs, capNs, tuneHz);
+            rxClock_.publish(rb_.writeIndex(), capNs, outFs);
+
+            // sbitx_ctrl acknowledged an LO write since the last period: it
+            // landed in this one (or, if capture is running late, after it)
+            const unsigned long long applied = ctrl_ ? ctrl_->freqApplied() : 0;
+            if (applied != loApplied)
             {
-                SoapySDR::logf(SOAPY_SDR_WARNING, "RX snd_pcm_readi recover failed: %s", snd_strerror((int)rd));
-                std::this_thread::sleep_for(std::chrono::milliseconds(5));
-                continue;
+                loApplied = applied;
+                rxLoMark_.store(rb_.writeIndex() + 1, std::memory_order_release);
             }
-            continue;
+            rbWrite(iq, o);
+            rxRingHigh_.note(rb_.fill());
         }
-
-        const size_t frames = (size_t)rd;
-
-        size_t o = 0;
-        for (size_t n = 0; n + 1 < frames; n += 2)
-        {
-            // sample n
-            float x0 = (float)inFrames[n*2 + 0] / 2147483647.0f;
-            float c0 = (float)std::cos(ph);
-            float s0 = (float)std::sin(ph);
-            std::complex<float> z0(x0 * c0, -x0 * s0); // x * e^{-j ph}
-            ph += w;
-            if (ph > M_PI) ph -= 2.0 * M_PI;
-
-            // sample n+1
-            float x1 = (float)inFrames[(n+1)*2 + 0] / 2147483647.0f;
-            float c1 = (float)std::cos(ph);
-            float s1 = (float)std::sin(ph);
-            std::complex<float> z1(x1 * c1, -x1 * s1);
-            ph += w;
-            if (ph > M_PI) ph -= 2.0 * M_PI;
-
-            // 2-tap LPF + decimate
-            std::complex<float> y = (z0 + z1) * 0.5f;
-
-            float I = y.real();
-            float Q = y.imag();
-
-            if (iqInv_) Q = -Q;
-            if (iqSwap_) std::swap(I, Q);
-
-            outIQ[o++] = std::complex<float>(I, Q);
-        }
-
-        if (o) rbWrite(outIQ.data(), o);
     }
-
-    rxPhase_ = ph;
 }
 
 // ------------------- ctrl TCP -------------------
 
-bool SBITXDevice::ctrlSendLine(const std::string &line) const
+// Commands are queued on ctrl_'s thread and never block the caller.
+bool SBITXDevice::ctrlSetFreqHz(long long hz) const
 {
-#ifndef __linux__
-    (void)line;
-    return false;
-#else
-    if (!ctrlEnabled_) return false;
+    if (!ctrl_) return false;
+    ctrl_->setFrequency(hz);
+    return true;
+}
 
-    addrinfo hints{};
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+// Pushed by sbitx_ctrl and cached in ctrl_; no I/O on the caller's thread.
+bool SBITXDevice::ctrlGetFreqHz(long long &hz) const
+{
+    bool ptt = false;
+    return ctrl_ && ctrl_->state(hz, ptt) && hz > 0;
+}
 
-    addrinfo *res = nullptr;
-    const std::string port = std::to_string(ctrlPort_);
-    if (getaddrinfo(ctrlHost_.c_str(), port.c_str(), &hints, &res) != 0) return false;
+bool SBITXDevice::ctrlSetPTT(bool on) const
+{
+    if (!ctrl_) return false;
+    ctrl_->setPTT(on);
+    return true;
+}
 
-    int fd = -1;
-    for (addrinfo *p = res; p; p = p->ai_next)
-    {
-        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (fd < 0) continue;
-        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
-        close(fd);
-        fd = -1;
-    }
-    freeaddrinfo(res);
-    if (fd < 0) return false;
 
-    std::string msg = line;
-    if (msg.empty() || msg.back() != '\n') msg.push_back('\n');
-    ssize_t w = ::write(fd, msg.data(), msg.size());
-    close(fd);
-    return w == (ssize_t)msg.size();
-#endif
+size_t SBITXDevice::getNumChannels(const int direction) const
+{
+    // RX 0 is the IF IQ, RX 1 the mic; one TX channel.
+    return direction == SOAPY_SDR_RX ? 2 : 1;
 }
 
-bool SBITXDevice::ctrlQueryLine(const std::string &line, std::string &reply) const
+bool SBITXDevice::getFullDuplex(const int /*direction*/, const size_t /*channel*/) const
 {
-#ifndef __linux__
-    (void)line; (void)reply;
+    // Not full-duplex: helps pihpsdr avoid assuming TX is always active.
     return false;
-#else
-    if (!ctrlEnabled_) return false;
+}
+
+bool SBITXDevice::hasHardwareTime(const std::string &what) const
+{
+    return what.empty();
+}
 
-    addrinfo hints{};
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+long long SBITXDevice::getHardwareTime(const std::string &) const
+{
+    return monotonicNs() + timeOffsetNs_.load(std::memory_order_relaxed);
+}
+
+void SBITXDevice::setHardwareTime(const long long timeNs, const std::string &)
+{
+    timeOffsetNs_.store(timeNs - monotonicNs(), std::memory_order_relaxed);
+}
 
-    addrinfo *res = nullptr;
-    const std::string port = std::to_string(ctrlPort_);
-    if (getaddrinfo(ctrlHost_.c_str(), port.c_str(), &hints, &res) != 0) return false;
+// ------------------- sensors -------------------
 
-    int fd = -1;
-    for (addrinfo *p = res; p; p = p->ai_next)
+struct SensorDesc
+{
+    const char *key;
+    const char *name;
+    const char *units;
+    const char *description;
+};
+
+// Counters are INT; latency sensors read as a summary string, and each has
+// a "_hist" twin with the raw power-of-two histogram.
+static const SensorDesc kCounterSensors[] = {
+    {"rx_xruns", "RX overruns", "", "ALSA capture overruns"},
+    {"tx_xruns", "TX underruns (ALSA)", "", "ALSA playback underruns, including the gaps between bursts"},
+    {"tx_underflows", "TX underflows", "", "Underruns inside a burst (reported by readStreamStatus)"},
+    {"tx_late_bursts", "Late TX bursts", "", "Timed bursts that could not start on time"},
+    {"rx_ring_drops", "RX ring drops", "samples", "Samples lost because the client fell behind"},
+    {"rx_ring_fill", "RX ring fill", "samples", "Samples waiting in the RX ring now"},
+    {"rx_ring_high_water", "RX ring high water", "samples", "Most samples ever waiting in the RX ring"},
+    {"tx_ring_high_water", "TX ring high water", "samples", "Most samples ever queued in the TX ring"},
+    {"rec_samples", "Recorded samples", "samples", "Samples queued for the current recording"},
+    {"rec_drops", "Recorder drops", "samples", "Samples the recording lost (disk too slow, rate change)"},
+    {"serve_clients", "Server clients", "", "Clients connected to serve="},
+    {"serve_drops", "Server drops", "samples", "Samples not sent to slow serve= clients, summed over clients"},
+    {"lo_writes", "LO writes", "", "Frequency changes sbitx_ctrl has applied to the synthesizer"},
+};
+
+static const SensorDesc kLatencySensors[] = {
+    {"rx_dsp_ns", "RX DSP time", "ns", "Capture to ring per period: mix, decimate, resample, convert"},
+    {"tx_dsp_ns", "TX DSP time", "ns", "Upconversion per ALSA write"},
+    {"rx_wakeup_jitter_ns", "RX wakeup jitter", "ns", "|time between RX thread wakeups - one period|"},
+    {"ctrl_rtt_ns", "sbitx_ctrl round trip", "ns", "Command sent to reply received"},
+    {"ptt_latency_ns", "PTT latency", "ns", "PTT change requested to sbitx_ctrl acknowledged"},
+};
+
+std::vector<std::string> SBITXDevice::listSensors(void) const
+{
+    std::vector<std::string> keys;
+    for (const auto &d : kCounterSensors) keys.push_back(d.key);
+    for (const auto &d : kLatencySensors)
     {
-        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (fd < 0) continue;
-        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
-        close(fd);
-        fd = -1;
+        keys.push_back(d.key);
+        keys.push_back(std::string(d.key) + "_hist");
     }
-    freeaddrinfo(res);
-    if (fd < 0) return false;
+    return keys;
+}
 
-    std::string msg = line;
-    if (msg.empty() || msg.back() != '\n') msg.push_back('\n');
-    if (::write(fd, msg.data(), msg.size()) != (ssize_t)msg.size())
+SoapySDR::ArgInfo SBITXDevice::getSensorInfo(const std::string &key) const
+{
+    SoapySDR::ArgInfo info;
+    info.key = key;
+    for (const auto &d : kCounterSensors)
     {
-        close(fd);
-        return false;
+        if (key != d.key) continue;
+        info.name = d.name;
+        info.units = d.units;
+        info.description = d.description;
+        info.type = SoapySDR::ArgInfo::INT;
+        info.value = "0";
     }
+    for (const auto &d : kLatencySensors)
+    {
+        const bool hist = key == std::string(d.key) + "_hist";
+        if (key != d.key && !hist) continue;
+        info.name = hist ? std::string(d.name) + " histogram" : d.name;
+        info.units = d.units;
+        info.description = hist ? "Non-empty buckets as upper_ns:count" : std::string(d.description) +
+                                  " (n, mean, p50/p99 bucket bounds, max)";
+        info.type = SoapySDR::ArgInfo::STRING;
+    }
+    return info;
+}
 
-    char buf[128];
-    ssize_t r = ::read(fd, buf, sizeof(buf)-1);
-    close(fd);
-    if (r <= 0) return false;
-    buf[r] = 0;
-
-    reply = std::string(buf);
-    // trim
-    while (!reply.empty() && (reply.back() == '\n' || reply.back() == '\r' || reply.back() == ' '))
-        reply.pop_back();
-    return !reply.empty();
-#endif
+std::string SBITXDevice::readSensor(const std::string &key) const
+{
+    if (key == "rx_xruns") return std::to_string(rxXruns_.load());
+    if (key == "tx_xruns") return std::to_string(txXruns_.load());
+    if (key == "tx_underflows") return std::to_string(txUnderruns_.load());
+    if (key == "tx_late_bursts") return std::to_string(txLateBursts_.load());
+    if (key == "rx_ring_drops") return std::to_string(rb_.dropped());
+    if (key == "rx_ring_fill") return std::to_string(rb_.fill());
+    if (key == "rx_ring_high_water") return std::to_string(rxRingHigh_.get());
+    if (key == "tx_ring_high_water") return std::to_string(txRingHigh_.get());
+    if (key == "rec_samples") return std::to_string(recorder_.samples());
+    if (key == "rec_drops") return std::to_string(recorder_.dropped());
+    if (key == "serve_clients") return std::to_string(server_ ? server_->clients() : 0);
+    if (key == "serve_drops") return std::to_string(server_ ? server_->dropped() : 0);
+    if (key == "lo_writes") return std::to_string(ctrl_ ? ctrl_->freqApplied() : 0);
+
+    // Latency sensors, plain or _hist
+    const bool hist = key.size() > 5 && key.compare(key.size() - 5, 5, "_hist") == 0;
+    const std::string base = hist ? key.substr(0, key.size() - 5) : key;
+    const LatencyStats *st = nullptr;
+    if (base == "rx_dsp_ns") st = &rxDspNs_;
+    else if (base == "tx_dsp_ns") st = &txDspNs_;
+    else if (base == "rx_wakeup_jitter_ns") st = &rxWakeJitterNs_;
+    else if (base == "ctrl_rtt_ns" && ctrl_) st = &ctrl_->rtt();
+    else if (base == "ptt_latency_ns" && ctrl_) st = &ctrl_->pttLatency();
+    else if (base == "ctrl_rtt_ns" || base == "ptt_latency_ns") return hist ? "" : "ctrl=none";
+
+    if (!st) throw std::runtime_error("SBITX: unknown sensor " + key);
+    return hist ? st->histogram() : st->summary();
 }
 
-bool SBITXDevice::ctrlSetFreqHz(long long hz) const
+// ------------------- settings -------------------
+
+SoapySDR::ArgInfoList SBITXDevice::getSettingInfo(void) const
 {
-    std::ostringstream ss;
-    ss << "F " << hz;
-    return ctrlSendLine(ss.str());
+    SoapySDR::ArgInfo rec;
+    rec.key = "record";
+    rec.value = "";
+    rec.name = "Record";
+    rec.description = "<path>[;raw][;direct] starts a SigMF recording of the RX stream "
+                      "(raw: the 96 kHz codec capture; direct: O_DIRECT), empty or \"stop\" stops it";
+    rec.type = SoapySDR::ArgInfo::STRING;
+
+    // getSampleRate reports the main RX rate; sub= streams run at this one.
+    SoapySDR::ArgInfo subRate;
+    subRate.key = "sub_rate";
+    subRate.value = std::to_string(subs_.rate());
+    subRate.name = "Sub-receiver rate";
+    subRate.description = "Read only: sample rate of every sub= stream, 2*fs/sub_bins";
+    subRate.units = "sps";
+    subRate.type = SoapySDR::ArgInfo::INT;
+    return {rec, subRate};
 }
 
-bool SBITXDevice::ctrlGetFreqHz(long long &hz) const
+void SBITXDevice::writeSetting(const std::string &key, const std::string &value)
 {
-    std::string rep;
-    if (!ctrlQueryLine("f", rep)) return false;
+    if (key == "sub_rate") throw std::runtime_error("SBITX: sub_rate is read only");
+    if (key != "record") throw std::runtime_error("SBITX: unknown setting " + key);
+    if (value.empty() || value == "stop")
+    {
+        recorder_.stop();
+        return;
+    }
 
-    // rep can be "14056000" or "OK 14056000" depending on implementation
-    long long val = 0;
-    if (rep.rfind("OK", 0) == 0)
+    // "<path>[;raw][;direct]"
+    std::string path;
+    bool raw = false, direct = false;
+    for (size_t start = 0; start <= value.size();)
     {
-        std::istringstream is(rep.substr(2));
-        is >> val;
+        const size_t end = std::min(value.find(';', start), value.size());
+        const std::string o = value.substr(start, end - start);
+        if (start == 0) path = o;
+        else if (o == "raw") raw = true;
+        else if (o == "direct") direct = true;
+        else if (!o.empty()) throw std::runtime_error("SBITX: record: unknown option " + o);
+        start = end + 1;
+    }
+
+    IQRecorder::Format f;
+    char desc[160];
+    if (raw)
+    {
+        f.datatype = "ri32_le";
+        f.sampleBytes = 2 * sizeof(int32_t);
+        f.channels = 2;
+        f.rate = capFs_;
+        std::snprintf(desc, sizeof(desc), "sBitx codec capture: channel 0 real IF at %.0f Hz, channel 1 mic",
+                      ifHz_);
     }
     else
     {
-        std::istringstream is(rep);
-        is >> val;
+        const RxFormat fmt = rxFormat_;
+        f.datatype = fmt == RX_CF32 ? "cf32_le" : fmt == RX_CS32 ? "ci32_le" : "ci16_le";
+        f.sampleBytes = rxFormatSize(fmt) * rxChannels_;
+        f.channels = rxChannels_;
+        f.rate = rxOutFs_.load();
+        std::snprintf(desc, sizeof(desc), "sBitx RX stream (IF %.0f Hz mixed to baseband%s)", ifHz_,
+                      rxChannels_ == 2 ? "; channel 1 mic" : "");
     }
-    if (val <= 0) return false;
-    hz = val;
-    return true;
-}
-
-bool SBITXDevice::ctrlSetPTT(bool on) const
-{
-    std::ostringstream ss;
-    ss << "T " << (on ? 1 : 0);
-    return ctrlSendLine(ss.str());
-}
+    f.description = desc;
 
-
-size_t SBITXDevice::getNumChannels(const int /*direction*/) const
-{
-    // One logical RX and one logical TX channel.
-    return 1;
+    recorder_.stop(); // before recordRaw_ changes under a running recording
+    recordRaw_.store(raw);
+    if (!recorder_.start(path, f, direct, tuneHz_.load()))
+        throw std::runtime_error("SBITX: record: cannot write " + path);
 }
 
-bool SBITXDevice::getFullDuplex(const int /*direction*/, const size_t /*channel*/) const
+std::string SBITXDevice::readSetting(const std::string &key) const
 {
-    // Not full-duplex: helps pihpsdr avoid assuming TX is always active.
-    return false;
+    if (key == "record") return recorder_.path();
+    if (key == "sub_rate") return std::to_string(subs_.rate());
+    return "";
 }
 
 int SBITXDevice::writeStream(
@@ -700,88 +1260,359 @@ int SBITXDevice::writeStream(
     const void * const *buffs,
     const size_t numElems,
     int &flags,
-    const long long,
-    const long)
+    const long long timeNs,
+    const long timeoutUs)
 {
+    const int inFlags = flags;
     flags = 0;
 
-    if (!pbHandle_)
+    if (!playback_)
         return SOAPY_SDR_STREAM_ERROR;
 
-    const auto *in =
-        reinterpret_cast<const std::complex<float> *>(buffs[0]);
+    // In case the client never called activateStream
+    if (!txRun_.load())
+    {
+        std::lock_guard<std::recursive_mutex> lock(streamMutex_);
+        startTxThread();
+    }
 
-    // Key PTT on first TX samples
-    if (!txActive_.load(std::memory_order_relaxed))
+    // Key PTT on first TX samples; a timed burst is keyed by the TX thread
+    // just before it starts.
+    const bool timed = (inFlags & SOAPY_SDR_HAS_TIME) != 0;
+    if (!timed && !txActive_.load(std::memory_order_relaxed) && !txTimedPending())
     {
         (void)ctrlSetPTT(true);
         txActive_.store(true, std::memory_order_relaxed);
     }
 
-    const auto nowNs =
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count();
+    lastTxNs_.store(monotonicNs(), std::memory_order_relaxed);
+
+    // Queue for the TX thread; only wait if the ring (or, for a timed
+    // burst, the marker queue) is full.
+    if (!txSpaceBell_.waitFor([&] {
+            return txRing_.freeSpace() > 0 &&
+                   (!timed || txMarkHead_.load() - txMarkTail_.load(std::memory_order_acquire) < kTxMarks);
+        }, timeoutUs))
+        return SOAPY_SDR_TIMEOUT;
+
+    // The marker goes out before the samples it points at.
+    if (timed)
+    {
+        const uint64_t head = txMarkHead_.load(std::memory_order_relaxed);
+        txMarks_[head % kTxMarks] = {txRing_.writeIndex(), timeNs - timeOffsetNs_.load(std::memory_order_relaxed)};
+        txMarkHead_.store(head + 1, std::memory_order_release);
+    }
+
+    const size_t n = std::min(numElems, txRing_.freeSpace());
+    txRing_.write(buffs[0], n);
+    txRingHigh_.note(txRing_.capacity() - txRing_.freeSpace());
+    txBurstEnded_.store((inFlags & SOAPY_SDR_END_BURST) != 0 && n == numElems,
+                        std::memory_order_relaxed);
+    txDataBell_.ring();
 
-    lastTxNs_.store(nowNs, std::memory_order_relaxed);
+    return (int)n;
+}
 
-    // 48k IQ → 96k real IF (RIGHT channel)
-    std::vector<int32_t> out(numElems * 2 * 2);
-    
-    const double w = 2.0 * M_PI * (ifHz_ / pbFs_);
-    double ph = txPhase_;
-    //txGainDb_ = -10.0;
-    size_t o = 0;
-    for (size_t n = 0; n < numElems; n++)
+int SBITXDevice::readStreamStatus(SoapySDR::Stream *stream, size_t &chanMask, int &flags,
+                                  long long &timeNs, const long timeoutUs)
 {
-    float I = in[n].real();
-    float Q = in[n].imag();
+    chanMask = 0;
+    flags = 0;
+    timeNs = 0;
 
-    if (iqSwap_)
-        std::swap(I, Q);
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s || s->direction != SOAPY_SDR_TX) return SOAPY_SDR_NOT_SUPPORTED;
+
+    if (!txStatusBell_.waitFor([&] { return txUnderruns_.load() != s->underrunsSeen ||
+                                            txLateBursts_.load() != s->lateSeen; }, timeoutUs))
+        return SOAPY_SDR_TIMEOUT;
 
-    for (int k = 0; k < 2; k++)   // two output samples
+    chanMask = 1;
+    if (txLateBursts_.load() != s->lateSeen)
     {
-        const float gain = txPaGain_.load(std::memory_order_relaxed) * (1.0f / 100.0f);
-        float y = I * std::cos(ph) - Q * std::sin(ph);
-        y *= gain;
-        ph += w;
-        if (ph > 2.0 * M_PI)
-            ph -= 2.0 * M_PI;
+        s->lateSeen = txLateBursts_.load();
+        return SOAPY_SDR_TIME_ERROR;
+    }
+    s->underrunsSeen = txUnderruns_.load();
+    return SOAPY_SDR_UNDERFLOW;
+}
 
-        int32_t s = float_to_s32(y);
+void SBITXDevice::startTxThread()
+{
+    if (txRun_.exchange(true)) return;
+    txThread_ = std::thread(&SBITXDevice::txThreadMain, this);
+}
 
-        out[o++] = 0;  // L unused
-        out[o++] = s;  // R = TX IF
+void SBITXDevice::stopTxThread()
+{
+    if (!txRun_.exchange(false)) return;
+    txDataBell_.ring();
+    if (txThread_.joinable()) txThread_.join();
+}
+
+// Last TX stream gone: let what is queued play out (up to one ring's worth
+// of time; a timed burst still waiting for its start is not waited for),
+// then stop the thread, drop whatever is left and unkey, so nothing stale
+// goes out on the next activation.
+void SBITXDevice::txShutdown()
+{
+    if (txRun_.load() && !txTimedPending())
+    {
+        const long drainUs = (long)(1e6 * (double)txRing_.capacity() / (double)fs_) + 50000;
+        txSpaceBell_.waitFor([&] { return txReader_.available() == 0 || txTimedPending(); }, drainUs);
     }
+    stopTxThread();
+
+    if (txReader_.valid()) txReader_.consume(txReader_.available());
+    txMarkTail_.store(txMarkHead_.load());
+    txBurstEnded_.store(false);
+    txSpaceBell_.ring();
+
+    if (txActive_.exchange(false)) (void)ctrlSetPTT(false);
 }
-    txPhase_ = ph;
 
-    const snd_pcm_uframes_t outFrames =
-    (snd_pcm_uframes_t)(numElems * 2);
+void SBITXDevice::txThreadMain()
+{
+    // Drain txRing_ one period at a time: 48k IQ -> 96k real IF -> playback_.
+    // The sink's blocking write paces the loop; when the client stalls, a
+    // partial period is flushed after one period's worth of waiting.
+    sbitx::enterThread({cpus_, rt_ ? rtPrio_ : 0}, "sbitx-tx");
+
+    const size_t periodIq = std::max<size_t>(1, periodFrames_ / 2);
+    const long periodUs = (long)(1e6 * (double)periodIq / (double)fs_);
+    std::vector<std::complex<float>> iq(periodIq);
+
+    while (txRun_.load())
+    {
+        txDataBell_.waitFor([&] { return txReader_.available() >= periodIq || !txRun_.load(); }, periodUs);
+
+        // Everything counted here was written after any marker we see next.
+        size_t want = std::min(periodIq, txReader_.available());
+        const uint64_t mark = txMarkTail_.load(std::memory_order_relaxed);
+        if (want && mark != txMarkHead_.load(std::memory_order_acquire))
+        {
+            // Play what precedes the next timed burst, then hold it until due.
+            const TxMark m = txMarks_[mark % kTxMarks];
+            const uint64_t rd = txReader_.readIndex();
+            if (rd < m.idx) want = (size_t)std::min<uint64_t>(want, m.idx - rd);
+            else if (!txStartTimed(m.dueNs)) continue;
+            else txMarkTail_.store(mark + 1, std::memory_order_release);
+        }
+
+        const size_t n = txReader_.read(iq.data(), want);
+        txSpaceBell_.ring();
+        if (!n) continue;
+
+        if (!txPlay(iq.data(), n))
+        {
+            SoapySDR::log(SOAPY_SDR_WARNING, "SBITX TX: playback write failed");
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
 
-snd_pcm_uframes_t written = 0;
+bool SBITXDevice::txPlay(const std::complex<float> *iq, size_t n)
+{
+    // Upconverts wherever the sink wants the frames (its DMA area with mmap)
+    struct Upconvert : FrameRenderer
+    {
+        SBITXDevice *dev;
+        const std::complex<float> *iq;
+        void render(size_t first, size_t frames, int32_t *dst, size_t stride) override
+        {
+            dev->txUpconvert(iq, first, frames, dst, stride);
+        }
+    } r;
+    r.dev = this;
+    r.iq = iq;
+
+    const bool ok = playback_->write(n * 2, r);
+    for (unsigned long long x = playback_->takeXruns(); x; x--) noteTxXrun();
+    txLastPlayNs_ = monotonicNs();
+    return ok;
+}
 
-while (written < outFrames)
+// A timed burst is next in txRing_. Keys PTT pttLeadNs_ ahead, and once the
+// burst is close enough queues silence so its first sample is heard at
+// dueNs; true when it should be played now. A burst that is already late
+// is played at once and reported through readStreamStatus.
+bool SBITXDevice::txStartTimed(long long dueNs)
 {
-    snd_pcm_sframes_t rc =
-        snd_pcm_writei(
-            pbHandle_,
-            out.data() + (written * 2),   // stereo = 2 ints per frame
-            outFrames - written);
+    const size_t periodIq = std::max<size_t>(1, periodFrames_ / 2);
+    const long long periodNs = (long long)(1e9 * (double)periodIq / (double)fs_);
+    const long long now = monotonicNs();
+    const long long queuedNs = playback_->queuedNs();
+
+    // Leave two periods for the silence and the first write.
+    const long long startAt = dueNs - queuedNs - 2 * periodNs;
+    const long long keyAt = std::min(dueNs - pttLeadNs_, startAt);
+
+    if (now >= keyAt)
+    {
+        if (!txActive_.load(std::memory_order_relaxed))
+        {
+            (void)ctrlSetPTT(true);
+            txActive_.store(true, std::memory_order_relaxed);
+        }
+        lastTxNs_.store(now, std::memory_order_relaxed); // keep the watchdog off
+    }
+
+    if (now < startAt)
+    {
+        const long long next = txActive_.load(std::memory_order_relaxed) ? startAt : keyAt;
+        const long us = (long)std::min<long long>((next - now) / 1000 + 1, 20000);
+        txDataBell_.waitFor([&] { return !txRun_.load(); }, us);
+        return false;
+    }
 
-    if (rc == -EAGAIN)
-        continue;
+    long long pad = (long long)((double)(dueNs - now - queuedNs) * fs_ / 1e9);
+    if (pad < -(long long)periodIq)
+    {
+        txLateBursts_.fetch_add(1);
+        txStatusBell_.ring();
+    }
 
-    if (rc < 0)
+    const std::vector<std::complex<float>> silence(periodIq);
+    while (pad > 0 && txRun_.load())
     {
-        rc = snd_pcm_recover(pbHandle_, (int)rc, 1);
-        if (rc < 0)
-            return SOAPY_SDR_STREAM_ERROR;
-        continue;
+        const size_t n = (size_t)std::min<long long>(pad, (long long)periodIq);
+        if (!txPlay(silence.data(), n)) break;
+        pad -= (long long)n;
     }
+    return true;
+}
 
-    written += (snd_pcm_uframes_t)rc;
+// Called per playback underrun: one inside a burst is something the
+// client should hear about through readStreamStatus.
+void SBITXDevice::noteTxXrun()
+{
+    txXruns_.fetch_add(1, std::memory_order_relaxed);
+    if (txBurstEnded_.exchange(false)) return;
+    if (txLastPlayNs_ == 0 || monotonicNs() - txLastPlayNs_ > kTxBurstGapNs) return;
+
+    txUnderruns_.fetch_add(1);
+    txStatusBell_.ring();
+}
+
+// 48k IQ → 96k real IF on the RIGHT channel (txChain_), at the PA drive.
+void SBITXDevice::txUpconvert(const std::complex<float> *in, size_t firstFrame, size_t frames,
+                              int32_t *dst, size_t stride)
+{
+    const long long t0 = monotonicNs();
+    const float gain = txPaGain_.load(std::memory_order_relaxed) * (1.0f / 100.0f);
+    txChain_.setShift((double)bbHz_.load(std::memory_order_relaxed), iqSwap_);
+    txChain_.upconvert(in, firstFrame, frames, dst, stride, gain, iqSwap_);
+    txDspNs_.record(monotonicNs() - t0);
+}
+
+// ------------------- direct buffer access -------------------
+
+size_t SBITXDevice::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
+{
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s) return 0;
+    // A two-channel ring interleaves the channels, sub streams have rings
+    // of their own and follow= streams convert: no buffer to hand out
+    if (s->direction == SOAPY_SDR_RX)
+        return rxChannels_ == 1 && s->sub < 0 && !s->follow ? rb_.capacity() / kDirectBlock : 0;
+    return txStage_.size();
+}
+
+int SBITXDevice::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
+{
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s || handle >= getNumDirectAccessBuffers(stream)) return SOAPY_SDR_NOT_SUPPORTED;
+
+    if (s->direction == SOAPY_SDR_RX)
+        buffs[0] = rb_.at(handle * kDirectBlock);
+    else
+        buffs[0] = txStage_[handle].data();
+    return 0;
+}
+
+int SBITXDevice::acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs,
+                                   int &flags, long long &timeNs, const long timeoutUs)
+{
+    flags = 0;
+    timeNs = 0;
+
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s || s->direction != SOAPY_SDR_RX || rxChannels_ != 1 || s->sub >= 0 || s->follow)
+        return SOAPY_SDR_NOT_SUPPORTED;
+    if (!s->active) return SOAPY_SDR_STREAM_ERROR;
+
+    const size_t want = std::max<size_t>(1, std::min(kDirectBlock, s->minBlock));
+    rbWait(s, want, timeoutUs);
+    if (rxOverflowed(s)) return SOAPY_SDR_OVERFLOW;
+
+    // A run never crosses a block boundary, so it maps onto one handle.
+    size_t n = 0;
+    uint64_t idx = 0;
+    const void *p = s->reader.peek(rxLoChange(s, kDirectBlock, flags), n, &idx);
+    n = std::min(n, kDirectBlock - (size_t)(idx % kDirectBlock));
+    if (!n) return SOAPY_SDR_TIMEOUT;
+
+    handle = (size_t)(idx / kDirectBlock) % getNumDirectAccessBuffers(stream);
+    buffs[0] = p;
+    if (rxTimeAt(idx, timeNs)) flags |= SOAPY_SDR_HAS_TIME;
+    s->acquired = n;
+    s->reads++;
+    s->samples += n;
+    return (int)n;
+}
+
+void SBITXDevice::releaseReadBuffer(SoapySDR::Stream *stream, const size_t)
+{
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s || !s->acquired || !s->active) return;
+    s->reader.consume(s->acquired);
+    s->acquired = 0;
+    if (overflow_ == OVERFLOW_BLOCK) rbSpaceBell_.ring();
 }
 
-return (int)numElems;
+int SBITXDevice::acquireWriteBuffer(SoapySDR::Stream *stream, size_t &handle, void **buffs, const long timeoutUs)
+{
+    auto *s = reinterpret_cast<SBITXStream*>(stream);
+    if (!s || s->direction != SOAPY_SDR_TX || txStage_.empty()) return SOAPY_SDR_NOT_SUPPORTED;
+
+    // Only hand out a stage the ring has room for, so its release never
+    // waits on a full ring.
+    handle = s->nextTxStage;
+    const size_t stage = txStage_[handle].size();
+    if (!txSpaceBell_.waitFor([&] { return txRing_.freeSpace() >= stage; }, timeoutUs))
+        return SOAPY_SDR_TIMEOUT;
+
+    s->nextTxStage = (s->nextTxStage + 1) % txStage_.size();
+    buffs[0] = txStage_[handle].data();
+    return (int)stage;
+}
+
+void SBITXDevice::releaseWriteBuffer(SoapySDR::Stream *stream, const size_t handle, const size_t numElems,
+                                     int &flags, const long long timeNs)
+{
+    if (handle >= txStage_.size()) return;
+
+    // Same path as writeStream, straight from the staging buffer, until
+    // all of it is queued. HAS_TIME belongs to the first chunk only;
+    // writeStream honours END_BURST only on a call it takes whole, which
+    // is the last one.
+    const std::complex<float> *p = txStage_[handle].data();
+    size_t left = std::min(numElems, txStage_[handle].size());
+    int chunkFlags = flags;
+    flags = 0;
+    while (left)
+    {
+        const void *buffs[1] = { p };
+        int f = chunkFlags;
+        const int n = writeStream(stream, buffs, left, f, timeNs, 100000);
+        if (n <= 0)
+        {
+            SoapySDR::logf(SOAPY_SDR_WARNING, "SBITX TX: releaseWriteBuffer dropped %lu samples (%d)",
+                           (unsigned long)left, n);
+            return;
+        }
+        p += n;
+        left -= (size_t)n;
+        chunkFlags &= ~SOAPY_SDR_HAS_TIME;
+    }
 }
@@ -3,12 +3,23 @@
 #include <SoapySDR/Device.hpp>
 #include <SoapySDR/Types.hpp>
 
-#include <alsa/asoundlib.h>
+#include "AudioIO.hpp"
+#include "Channelizer.hpp"
+#include "CtrlClient.hpp"
+#include "Doorbell.hpp"
+#include "DspChain.hpp"
+#include "IQRing.hpp"
+#include "IQServer.hpp"
+#include "RealTime.hpp"
+#include "Recorder.hpp"
+#include "SampleClock.hpp"
+#include "Stats.hpp"
 
 #include <atomic>
 #include <chrono>
 #include <complex>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -66,7 +77,10 @@ public:
                                   const std::vector<size_t> &channels,
                                   const SoapySDR::Kwargs &args) override;
 
+    SoapySDR::ArgInfoList getStreamArgsInfo(const int direction, const size_t channel) const override;
+
     void closeStream(SoapySDR::Stream *stream) override;
+    size_t getStreamMTU(SoapySDR::Stream *stream) const override;
     // Antenna
     std::vector<std::string> listAntennas(const int, const size_t) const override;
     void setAntenna(const int, const size_t, const std::string &) override;
@@ -84,42 +98,144 @@ public:
     int writeStream(SoapySDR::Stream *stream, const void * const *buffs, const size_t numElems,
                     int &flags, const long long timeNs, const long timeoutUs) override;
 
+    int readStreamStatus(SoapySDR::Stream *stream, size_t &chanMask, int &flags,
+                         long long &timeNs, const long timeoutUs) override;
+
+    // Time: CLOCK_MONOTONIC, shifted by setHardwareTime. RX samples are
+    // stamped from ALSA capture timestamps, TX bursts can start at a time.
+    bool hasHardwareTime(const std::string &what = "") const override;
+    long long getHardwareTime(const std::string &what = "") const override;
+    void setHardwareTime(const long long timeNs, const std::string &what = "") override;
+
+    // Sensors: live driver counters and latency histograms
+    std::vector<std::string> listSensors(void) const override;
+    SoapySDR::ArgInfo getSensorInfo(const std::string &key) const override;
+    std::string readSensor(const std::string &key) const override;
+
+    // Settings: "record" starts / stops the SigMF recorder
+    SoapySDR::ArgInfoList getSettingInfo(void) const override;
+    void writeSetting(const std::string &key, const std::string &value) override;
+    std::string readSetting(const std::string &key) const override;
+
+    // Direct buffer access: RX reads straight out of the IQ ring, TX writes
+    // into the staging buffers that feed writeStream.
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream) override;
+    int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs) override;
+    int acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs,
+                          int &flags, long long &timeNs, const long timeoutUs) override;
+    void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle) override;
+    int acquireWriteBuffer(SoapySDR::Stream *stream, size_t &handle, void **buffs,
+                           const long timeoutUs) override;
+    void releaseWriteBuffer(SoapySDR::Stream *stream, const size_t handle, const size_t numElems,
+                            int &flags, const long long timeNs) override;
+
 private:
+    // What the RX thread does when the ring is full (overflow=)
+    enum OverflowPolicy
+    {
+        OVERFLOW_DROP_OLDEST, // overwrite what the reader has not taken yet
+        OVERFLOW_DROP_NEWEST, // throw away the new period
+        OVERFLOW_BLOCK,       // wait for the reader; ALSA overruns if it never comes
+    };
+
     // Stream tag so closeStream knows what it is
     struct SBITXStream
     {
         int direction; // SOAPY_SDR_RX or SOAPY_SDR_TX
-        size_t channel;
+        std::vector<size_t> channels; // buffs[i] carries channels[i]
+        RxFormat format = RX_CF32;
+
+        // RX: readStream waits for at least this many samples (0 = any)
+        size_t minBlock = 0;
+
+        // RX: sub-receiver slot in subs_ (sub=), -1 for a full-rate stream
+        int sub = -1;
+
+        // RX: follow=, CF32 channel 0 converted from whatever rb_ holds
+        bool follow = false;
+
+        // RX: this stream's cursor into rb_ (or its sub-receiver's ring),
+        // attached while active
+        IQRing::Reader reader{};
+        bool active = false;
+
+        // RX on a two-channel ring: whole samples land here, then get
+        // split into the stream's buffers
+        std::vector<uint8_t> scratch{};
+
+        // RX: the last LO change (rxLoMark_) already flagged
+        uint64_t loMarkSeen = 0;
+
+        // RX: ring drops and capture overruns already reported as overflow
+        uint64_t droppedSeen = 0;
+        unsigned long long xrunsSeen = 0;
+
+        // Direct access: samples handed out by acquireReadBuffer, and the
+        // next TX staging buffer for acquireWriteBuffer
+        size_t acquired = 0;
+        size_t nextTxStage = 0;
+
+        // TX: underruns and late bursts already reported by readStreamStatus
+        unsigned long long underrunsSeen = 0;
+        unsigned long long lateSeen = 0;
+
+        // RX delivery stats (reported on closeStream)
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        unsigned long long reads = 0;
+        unsigned long long wakeups = 0;
+        unsigned long long samples = 0;
     };
     
     //std::atomic<float> txPaGain_{1.0f}; //linear pa drive
     //double txGainDb_ = 0.0; //tx if gain
-    // ALSA
-    bool openAlsaCapture();
-    void closeAlsaCapture();
-    bool openAlsaPlayback();
-    void closeAlsaPlayback();
+    // Capture / playback backends (AudioIO.hpp), opened with the first stream
+    bool openCapture();
+    bool openPlayback();
+    AudioConfig audioConfig(unsigned rate) const;
+
+    void txUpconvert(const std::complex<float> *in, size_t firstFrame, size_t frames,
+                     int32_t *dst, size_t stride);
 
     // RX thread + ringbuffer
+    void prefaultRx();
+    void relayoutRx(RxFormat fmt, unsigned channels);
     void startRxThread();
     void stopRxThread();
     void rxThreadMain();
 
-    void rbWrite(const std::complex<float> *in, size_t n);
-    size_t rbRead(std::complex<float> *out, size_t n);
-
-    // Control (TCP to sbitx_ctrl)
-    bool ctrlSendLine(const std::string &line) const;
-    bool ctrlQueryLine(const std::string &line, std::string &reply) const;
+    static size_t rxFormatSize(RxFormat fmt);
+    void pttWatchdog();
+
+    // TX thread: drains txRing_ into playback_ one period at a time
+    void startTxThread();
+    void stopTxThread();
+    void txShutdown();
+    void txThreadMain();
+    bool txPlay(const std::complex<float> *iq, size_t n);
+    bool txStartTimed(long long dueNs);
+    void noteTxXrun();
+
+    void rbWrite(const void *in, size_t n);
+    size_t rbRead(SBITXStream *s, void * const *buffs, size_t n, uint64_t *index);
+    static bool usesMic(const SBITXStream *s);
+    bool rxTimeAt(uint64_t index, long long &timeNs) const;
+    bool rbWait(SBITXStream *s, size_t want, long timeoutUs);
+    bool rxOverflowed(SBITXStream *s);
+    size_t rxLoChange(SBITXStream *s, size_t n, int &flags);
+
+    // Control (sbitx_ctrl over TCP or AF_UNIX, via ctrl_)
     bool ctrlSetFreqHz(long long hz) const;
     bool ctrlGetFreqHz(long long &hz) const;
     bool ctrlSetPTT(bool on) const;
+    long long syncLoHz();
 
 private:
     // Args / config
-    std::string alsaDev_ = "hw:0,0";
+    std::string alsaDev_ = "hw:0,0"; // capture: ALSA device, file: or synth:
+    std::string txDev_ = "hw:0,0";   // playback: ALSA device, file: or null
 
-    unsigned int fs_ = 48000;
+    unsigned int fs_ = 48000;                  // rate out of the halfband decimator
+    std::atomic<unsigned int> rxOutFs_{48000}; // RX stream rate (RateChain after fs_)
     unsigned int capFs_ = 96000;
     unsigned int pbFs_  = 96000;
 
@@ -127,23 +243,39 @@ private:
     bool iqSwap_ = false;
     bool iqInv_  = false; // invert Q if needed (fix spectrum mirror)
 
-    snd_pcm_uframes_t periodFrames_ = 1000;
-    snd_pcm_uframes_t bufferFrames_ = 4000;
+    bool mmapRequested_ = false; // access=mmap
 
+    size_t periodFrames_ = 1000;
+    size_t bufferFrames_ = 4000;
+
+    // rt=1: SCHED_FIFO rtPrio_ for the RX and TX threads, memory locked.
+    // cpu=: the RX, TX and ctrl threads' cores.
     bool rt_ = false;
     int rtPrio_ = 70;
+    std::vector<int> cpus_;
+    bool memLocked_ = false;
+
+    // Timed TX bursts key PTT this long before their first sample (ptt_lead=, ms)
+    long long pttLeadNs_ = 20000000;
 
-    // ctrl="host:port"  (default 127.0.0.1:9999)
+    // ctrl="host:port"  (default 127.0.0.1:9999) or "unix:/path"
     std::string ctrlHost_ = "127.0.0.1";
     int ctrlPort_ = 9999;
+    std::string ctrlUnix_;
     bool ctrlEnabled_ = true;
+    std::unique_ptr<CtrlClient> ctrl_; // null when ctrl=none
 
-    // State
+    // State: tuneHz_ = loHz_ + bbHz_. loHz_ is the RF at the centre of the
+    // passband (hardware LO + IF) as last sent, bbHz_ the fine-tuning
+    // offset the IF NCOs add to it ("BB").
     mutable std::atomic<long long> tuneHz_{0};
+    std::atomic<long long> loHz_{0};
+    std::atomic<long long> bbHz_{0};
+    long long tuneWindowHz_ = 0; // tune_window=: RF moves this small only move bbHz_
 
-    // ALSA handles
-    snd_pcm_t *capHandle_ = nullptr;
-    snd_pcm_t *pbHandle_  = nullptr;
+    // Null while no stream of that direction is open
+    std::unique_ptr<CaptureSource> capture_;
+    std::unique_ptr<PlaybackSink> playback_;
 
     std::atomic<bool> txActive_{false};
     std::atomic<long long> lastTxNs_{0};
@@ -151,19 +283,98 @@ private:
     std::atomic<bool> rxRun_{false};
     std::thread rxThread_;
 
-    // Ring buffer for IQ
-    std::vector<std::complex<float>> rb_;
-    size_t rbSize_ = 0;
-    size_t rbHead_ = 0;
-    size_t rbTail_ = 0;
-    std::mutex rbMutex_;
+    // Ring buffer for IQ (lock-free broadcast: RX thread -> each active
+    // RX stream's reader), holding samples in rxFormat_ for rxChannels_
+    // channels side by side (both fixed by the first plain RX stream)
+    IQRing rb_;
+    RxFormat rxFormat_ = RX_CF32;
+    unsigned rxChannels_ = 1;
+
+    // readStream sleeps here until the ring holds enough samples, and
+    // with overflow=block the RX thread sleeps on rbSpaceBell_ for room
+    Doorbell rbBell_;
+    Doorbell rbSpaceBell_;
+    OverflowPolicy overflow_ = OVERFLOW_DROP_OLDEST;
+    std::atomic<unsigned long long> rxXruns_{0}; // capture overruns
+
+    // rb_ index + 1 of the first sample of the period in which sbitx_ctrl
+    // last acknowledged an LO write (0 = none since the ring was reset)
+    std::atomic<uint64_t> rxLoMark_{0};
+
+    // Ring index -> sample time, and the offset set by setHardwareTime
+    SampleClock rxClock_;
+    std::atomic<long long> timeOffsetNs_{0};
+
+    // TX: writeStream -> txRing_ (CF32 @48k) -> TX thread -> playback_
+    IQRing txRing_;
+    IQRing::Reader txReader_; // TX thread
+    Doorbell txDataBell_;   // rung by writeStream
+    Doorbell txSpaceBell_;  // rung by the TX thread after each read
+    Doorbell txStatusBell_; // rung on underrun, for readStreamStatus
+    std::atomic<bool> txRun_{false};
+    std::thread txThread_;
+    std::atomic<bool> txBurstEnded_{false};
+    std::atomic<unsigned long long> txUnderruns_{0};
+    long long txLastPlayNs_ = 0; // TX thread only
+
+    // Pending timed bursts, oldest first: each one's first txRing_ index
+    // and monotonic start time. writeStream pushes at txMarkHead_, the TX
+    // thread pops at txMarkTail_ once the burst starts. Bursts that could
+    // not start on time are counted.
+    struct TxMark
+    {
+        uint64_t idx;
+        long long dueNs;
+    };
+    static constexpr size_t kTxMarks = 16;
+    TxMark txMarks_[kTxMarks] = {};
+    std::atomic<uint64_t> txMarkHead_{0};
+    std::atomic<uint64_t> txMarkTail_{0};
+    bool txTimedPending() const { return txMarkHead_.load(std::memory_order_acquire) != txMarkTail_.load(std::memory_order_acquire); }
+    std::atomic<unsigned long long> txLateBursts_{0};
+    std::atomic<unsigned long long> txXruns_{0}; // every playback underrun, bursts or not
+
+    // Telemetry, each written by one thread only (see Stats.hpp)
+    LatencyStats rxDspNs_;        // RX thread: capture -> ring, per period
+    LatencyStats rxWakeJitterNs_; // RX thread: |wakeup interval - period|
+    LatencyStats txDspNs_;        // TX thread: upconversion, per write
+    HighWater rxRingHigh_;        // RX thread
+    HighWater txRingHigh_;        // writeStream
+
+    // record=: tees the raw capture or the RX stream to disk (Recorder.hpp)
+    IQRecorder recorder_;
+    std::atomic<bool> recordRaw_{false};
+
+    // serve=: rtl_tcp-style network clients, one more RX stream (IQServer.hpp)
+    std::unique_ptr<IQServer> server_;
+    std::string serveAddr_;
+
+    // sub=: narrow RX streams cut out of channel 0 (Channelizer.hpp)
+    SubReceivers subs_;
+
+    // setupStream / closeStream / activateStream / deactivateStream come
+    // from the application and the serve= thread at once; this serializes
+    // them (recursive: closeStream deactivates under it).
+    std::recursive_mutex streamMutex_;
+
+    // Under streamMutex_: RX streams that fix rb_'s layout (neither sub=
+    // nor follow=), and the follow= ones. rxLayoutMutex_ keeps a follow=
+    // readStream out of relayoutRx().
+    int rxRingUsers_ = 0;
+    std::vector<SBITXStream*> rxFollowers_;
+    std::mutex rxLayoutMutex_;
 
     // Stream users (THIS fixes your rxUsers_/txUsers_ errors)
     std::atomic<int> rxUsers_{0};
+    std::atomic<int> rxActive_{0}; // RX streams activated; the RX thread runs while > 0
+    std::atomic<int> rxMicActive_{0}; // ... of them reading channel 1 (mic DSP on while > 0)
     std::atomic<int> txUsers_{0};
+    std::atomic<int> txActiveStreams_{0}; // TX streams activated; see deactivateStream
+
+    // TX staging buffers handed out by acquireWriteBuffer (one MTU each)
+    std::vector<std::vector<std::complex<float>>> txStage_;
 
-    // TX buffer reuse (THIS fixes txFrames_ errors)
-    std::vector<int32_t> txFrames_;
-    double txPhase_ = 0.0;
-    double rxPhase_ = 0.0;
+    // Signal path (DspChain.hpp): RX thread / TX thread only
+    RxChain rxChain_;
+    TxChain txChain_;
 };
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+// RX sample index <-> CLOCK_MONOTONIC nanoseconds.
+//
+// Each capture period the RX thread measures when the period's first frame
+// was sampled (ALSA timestamps). Those readings carry scheduling jitter, so
+// they only steer a running frame count through a slow first-order loop;
+// a reading more than kSlipNs off the prediction (an overrun lost frames)
+// re-anchors it instead.
+//
+// The smoothed time is then published together with the ring index of the
+// period's first output sample and the output rate, behind a seqlock, so any
+// thread can turn a ring index into a time without locking.
+class SampleClock
+{
+public:
+    static constexpr long long kSlipNs = 2000000; // 2 ms
+    static constexpr long long kLoopDiv = 64;     // loop gain 1/64
+
+    // RX thread: forget the old anchor (stream restarted)
+    void reset()
+    {
+        locked_ = false;
+        frames_ = 0;
+        publish(0, 0, 0);
+    }
+
+    // RX thread: `frames` were captured at `fs`, the first of them at
+    // measuredNs. Returns the smoothed time of that first frame.
+    long long capture(long long measuredNs, size_t frames, unsigned fs)
+    {
+        const long long predicted =
+            anchorNs_ + (long long)((double)(frames_ - anchorFrame_) * 1e9 / fs);
+        const long long err = measuredNs - predicted;
+
+        long long t;
+        if (!locked_ || std::llabs(err) > kSlipNs)
+        {
+            anchorNs_ = measuredNs;
+            anchorFrame_ = frames_;
+            locked_ = true;
+            t = measuredNs;
+        }
+        else
+        {
+            anchorNs_ += err / kLoopDiv;
+            t = predicted + err / kLoopDiv;
+        }
+        frames_ += frames;
+        return t;
+    }
+
+    // RX thread: ring index `index` (output rate fs) was sampled at ns.
+    void publish(uint64_t index, long long ns, unsigned fs)
+    {
+        const uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        index_.store(index, std::memory_order_relaxed);
+        ns_.store(ns, std::memory_order_relaxed);
+        fs_.store(fs, std::memory_order_relaxed);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    // Any thread: time of ring index `index`; false before the first period.
+    bool timeAt(uint64_t index, long long &ns) const
+    {
+        uint64_t i;
+        long long t;
+        unsigned fs;
+        for (;;)
+        {
+            const uint32_t s = seq_.load(std::memory_order_acquire);
+            if (s & 1) continue;
+            i = index_.load(std::memory_order_relaxed);
+            t = ns_.load(std::memory_order_relaxed);
+            fs = fs_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == s) break;
+        }
+        if (!fs) return false;
+
+        // Signed: the index may be older than the anchor.
+        ns = t + (long long)((double)(int64_t)(index - i) * 1e9 / fs);
+        return true;
+    }
+
+private:
+    // RX thread only
+    bool locked_ = false;
+    uint64_t frames_ = 0;
+    uint64_t anchorFrame_ = 0;
+    long long anchorNs_ = 0;
+
+    std::atomic<uint32_t> seq_{0};
+    std::atomic<uint64_t> index_{0};
+    std::atomic<long long> ns_{0};
+    std::atomic<unsigned> fs_{0};
+};
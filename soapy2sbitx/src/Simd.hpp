@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SBITX_SIMD_NEON 1
+#elif defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define SBITX_SIMD_SSE 1
+#endif
+
+// Shared FIR helpers. I and Q are kept in separate arrays so one set of
+// real taps drives both with plain vector multiply-adds.
+namespace sbitx
+{
+
+// Filter buffers are padded to a multiple of this many floats.
+constexpr size_t kSimdWidth = 4;
+
+// Two dot products (I and Q) against the same taps; n is a multiple of 4.
+inline void dot2(const float *re, const float *im, const float *h, size_t n,
+                 float &outRe, float &outIm)
+{
+#if defined(SBITX_SIMD_NEON)
+    float32x4_t ar = vdupq_n_f32(0.0f), ai = vdupq_n_f32(0.0f);
+    for (size_t k = 0; k < n; k += 4)
+    {
+        const float32x4_t c = vld1q_f32(h + k);
+        ar = vmlaq_f32(ar, c, vld1q_f32(re + k));
+        ai = vmlaq_f32(ai, c, vld1q_f32(im + k));
+    }
+    // vaddvq_f32 is AArch64-only; this also works on 32-bit Pi OS.
+    float32x2_t sr = vadd_f32(vget_low_f32(ar), vget_high_f32(ar));
+    float32x2_t si = vadd_f32(vget_low_f32(ai), vget_high_f32(ai));
+    const float32x2_t s = vpadd_f32(sr, si);
+    outRe = vget_lane_f32(s, 0);
+    outIm = vget_lane_f32(s, 1);
+#elif defined(SBITX_SIMD_SSE)
+    __m128 ar = _mm_setzero_ps(), ai = _mm_setzero_ps();
+    for (size_t k = 0; k < n; k += 4)
+    {
+        const __m128 c = _mm_loadu_ps(h + k);
+        ar = _mm_add_ps(ar, _mm_mul_ps(c, _mm_loadu_ps(re + k)));
+        ai = _mm_add_ps(ai, _mm_mul_ps(c, _mm_loadu_ps(im + k)));
+    }
+    // [r0+r1, r2+r3, i0+i1, i2+i3] then fold the halves
+    const __m128 lo = _mm_shuffle_ps(ar, ai, _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 hi = _mm_shuffle_ps(ar, ai, _MM_SHUFFLE(3, 1, 3, 1));
+    const __m128 p = _mm_add_ps(lo, hi);
+    float t[4];
+    _mm_storeu_ps(t, p);
+    outRe = t[0] + t[1];
+    outIm = t[2] + t[3];
+#else
+    float sr = 0.0f, si = 0.0f;
+    for (size_t k = 0; k < n; k++)
+    {
+        sr += h[k] * re[k];
+        si += h[k] * im[k];
+    }
+    outRe = sr;
+    outIm = si;
+#endif
+}
+
+// Modified Bessel function I0, enough terms for the Kaiser window.
+inline double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+} // namespace sbitx
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Single-writer latency histogram, readable from any thread.
+//
+// Only the owning thread calls record(), so it gets by with relaxed loads
+// and stores: no locked read-modify-write, no fence, a handful of moves per
+// sample, which is cheap enough for the RT threads. Readers may see a
+// sample half-recorded (count bumped, bucket not yet), nothing worse.
+//
+// Bucket i holds values below 2^i ns.
+class LatencyStats
+{
+public:
+    static constexpr int kBuckets = 40; // up to ~9 minutes
+
+    void record(long long ns)
+    {
+        const uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+        const int b = std::min(kBuckets - 1, v ? 64 - __builtin_clzll(v) : 0);
+        bump(buckets_[b], 1);
+        bump(count_, 1);
+        bump(sumNs_, v);
+        if (v > maxNs_.load(std::memory_order_relaxed)) maxNs_.store(v, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t maxNs() const { return maxNs_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the p-th fraction of samples
+    uint64_t percentileNs(double p) const
+    {
+        const uint64_t n = count();
+        if (!n) return 0;
+        const uint64_t want = std::max<uint64_t>(1, (uint64_t)(p * (double)n + 0.5));
+        uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; b++)
+        {
+            seen += buckets_[b].load(std::memory_order_relaxed);
+            if (seen >= want) return std::min(1ULL << b, (unsigned long long)maxNs());
+        }
+        return maxNs();
+    }
+
+    // "n=.. mean=.. p50<.. p99<.. max=.." in ns
+    std::string summary() const
+    {
+        const uint64_t n = count();
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "n=%llu mean=%llu p50<%llu p99<%llu max=%llu",
+                      (unsigned long long)n,
+                      (unsigned long long)(n ? sumNs_.load(std::memory_order_relaxed) / n : 0),
+                      (unsigned long long)percentileNs(0.50), (unsigned long long)percentileNs(0.99),
+                      (unsigned long long)maxNs());
+        return buf;
+    }
+
+    // Non-empty buckets as "upper_ns:count" pairs
+    std::string histogram() const
+    {
+        std::string out;
+        for (int b = 0; b < kBuckets; b++)
+        {
+            const uint64_t c = buckets_[b].load(std::memory_order_relaxed);
+            if (!c) continue;
+            if (!out.empty()) out += ',';
+            out += std::to_string(1ULL << b) + ':' + std::to_string(c);
+        }
+        return out;
+    }
+
+private:
+    static void bump(std::atomic<uint64_t> &a, uint64_t v)
+    {
+        a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sumNs_{0};
+    std::atomic<uint64_t> maxNs_{0};
+};
+
+// Single-writer high-water mark, same rules as LatencyStats.
+class HighWater
+{
+public:
+    void note(uint64_t v)
+    {
+        if (v > max_.load(std::memory_order_relaxed)) max_.store(v, std::memory_order_relaxed);
+    }
+    uint64_t get() const { return max_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> max_{0};
+};